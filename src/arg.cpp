@@ -8,6 +8,10 @@ const size_t Arguments::SEARCH_BINARY = 3;
 
 const size_t Arguments::CUT_ALGO_EQUIDISTANT = 4;
 const size_t Arguments::CUT_ALGO_UNEQUAL = 5;
+const size_t Arguments::CUT_ALGO_HYPERCUTS = 6;
+const size_t Arguments::CUT_ALGO_HYPERSPLIT = 7;
+
+const size_t Arguments::DIM_CHOICE_COST = 8;
 
 inline bool is_digit(const char c) {
   return c >= 48 && c <= 57;
@@ -65,10 +69,12 @@ void Arguments::parse_dim_choice(const std::string& input) {
     dim_choice_ = Arguments::DIM_CHOICE_MAX_DISTINCT;
   else if (input == "least-max")
     dim_choice_ = Arguments::DIM_CHOICE_LEAST_MAX_RULES;
+  else if (input == "cost")
+    dim_choice_ = Arguments::DIM_CHOICE_COST;
   else {
     std::stringstream ss;
     ss << "Invalid parameter --dim-choice ('" << input
-        << "'): must be 'max-dist' or 'least-max'!";
+        << "'): must be 'max-dist', 'least-max' or 'cost'!";
     throw ss.str();
   }
 }
@@ -93,10 +99,15 @@ void Arguments::parse_cut_algo(const std::string& input) {
     cut_algo_ = Arguments::CUT_ALGO_EQUIDISTANT;
   else if (input == "unequal")
     cut_algo_ = Arguments::CUT_ALGO_UNEQUAL;
+  else if (input == "hypercuts")
+    cut_algo_ = Arguments::CUT_ALGO_HYPERCUTS;
+  else if (input == "hypersplit")
+    cut_algo_ = Arguments::CUT_ALGO_HYPERSPLIT;
   else {
     std::stringstream ss;
     ss << "Invalid parameter --cut-algo ('" << input
-        << "'): must be 'equidistant' or 'unequal'!";
+        << "'): must be 'equidistant', 'unequal', "
+        << "'hypercuts' or 'hypersplit'!";
     throw ss.str();
   }
 }
@@ -148,6 +159,15 @@ Arguments Arguments::parse_arg_vector(const StrVector& arg_vector) {
     } else if (arg == "--verbose") {
       args.set_verbose(true);
 
+    } else if (arg == "--separate-large") {
+      args.set_separate_large(true);
+
+    } else if (arg == "--compact-regions") {
+      args.set_compact_regions(true);
+
+    } else if (arg == "--autotune") {
+      args.set_autotune(true);
+
     } else if (arg == "--min-rules") {
       ++i;
       check_arg_index(i, num_args);
@@ -165,6 +185,11 @@ Arguments Arguments::parse_arg_vector(const StrVector& arg_vector) {
       args.parse_outfile(arg_vector[i]);
       outfile_specified = true;
 
+    } else if (arg == "--trace") {
+      ++i;
+      check_arg_index(i, num_args);
+      args.parse_trace_file(arg_vector[i]);
+
     } else if (arg == "--random-seed") {
       ++i;
       check_arg_index(i, num_args);
@@ -175,6 +200,11 @@ Arguments Arguments::parse_arg_vector(const StrVector& arg_vector) {
       check_arg_index(i, num_args);
       args.parse_cut_algo(arg_vector[i]);
 
+    } else if (arg == "--jobs") {
+      ++i;
+      check_arg_index(i, num_args);
+      args.parse_jobs(arg_vector[i]);
+
     } else {
       std::stringstream ss;
       ss << "Unknown argument '" << arg << "'!";
@@ -9,8 +9,10 @@ class Arguments {
 public:
   Arguments() : binth_(4), spfac_(4), dim_choice_(0),
       search_(Arguments::SEARCH_LINEAR), infile_(""), outfile_(""),
+      trace_file_(""),
       verbose_(false), min_rules_(10), random_seed_(0),
-      cut_algo_(Arguments::CUT_ALGO_EQUIDISTANT) {}
+      cut_algo_(Arguments::CUT_ALGO_EQUIDISTANT), jobs_(1),
+      separate_large_(false), compact_regions_(false), autotune_(false) {}
   
   Arguments& operator=(const Arguments& rhs) {
     binth_ = rhs.binth();
@@ -19,10 +21,15 @@ public:
     dim_choice_ = rhs.dim_choice();
     infile_ = rhs.infile();
     outfile_ = rhs.outfile();
+    trace_file_ = rhs.trace_file();
     verbose_ = rhs.verbose();
     min_rules_ = rhs.min_rules();
     random_seed_ = rhs.random_seed();
     cut_algo_ = rhs.cut_algo();
+    jobs_ = rhs.jobs();
+    separate_large_ = rhs.separate_large();
+    compact_regions_ = rhs.compact_regions();
+    autotune_ = rhs.autotune();
     return *this;
   }
 
@@ -49,12 +56,15 @@ public:
   // dimension choice parameter
   static const size_t DIM_CHOICE_MAX_DISTINCT;
   static const size_t DIM_CHOICE_LEAST_MAX_RULES;
+  static const size_t DIM_CHOICE_COST;
   inline size_t dim_choice() const {return dim_choice_;}
   void parse_dim_choice(const std::string& input);
 
   // cut algorithm
   static const size_t CUT_ALGO_EQUIDISTANT;
   static const size_t CUT_ALGO_UNEQUAL;
+  static const size_t CUT_ALGO_HYPERCUTS;
+  static const size_t CUT_ALGO_HYPERSPLIT;
   inline size_t cut_algo() const {return cut_algo_;}
   void parse_cut_algo(const std::string& input);
 
@@ -72,6 +82,12 @@ public:
   inline const std::string& outfile() const {return outfile_;}
   inline void parse_outfile(const std::string& input) {outfile_ = input;}
 
+  // packet trace weighting the tree construction
+  inline const std::string& trace_file() const {return trace_file_;}
+  inline void parse_trace_file(const std::string& input) {
+    trace_file_ = input;
+  }
+
   // verbose
   inline const bool verbose() const {return verbose_;}
   inline void set_verbose(const bool verbose) {verbose_ = verbose;}
@@ -84,6 +100,32 @@ public:
   inline size_t random_seed() const {return random_seed_;}
   void parse_random_seed(const std::string& input);
 
+  // number of worker threads used during tree construction
+  static const size_t MIN_JOBS = 1;
+  static const size_t MAX_JOBS = 1024;
+  inline size_t jobs() const {return jobs_;}
+
+  inline void parse_jobs(const std::string& input) {
+    jobs_ = parse_int_param(input, "--jobs", Arguments::MIN_JOBS,
+        Arguments::MAX_JOBS);
+  }
+
+  // separation of rules with large fields into trees of their own
+  inline bool separate_large() const {return separate_large_;}
+  inline void set_separate_large(const bool separate_large) {
+    separate_large_ = separate_large;
+  }
+
+  // region compaction of child boxes during tree construction
+  inline bool compact_regions() const {return compact_regions_;}
+  inline void set_compact_regions(const bool compact_regions) {
+    compact_regions_ = compact_regions;
+  }
+
+  // search for the tree parameters with the least estimated packet cost
+  inline bool autotune() const {return autotune_;}
+  inline void set_autotune(const bool autotune) {autotune_ = autotune;}
+
   /*
    * Parses an entire argument vector.
    * Returns an Arguments object in case of success or throws an std::string in
@@ -98,10 +140,15 @@ private:
   size_t search_;
   std::string infile_;
   std::string outfile_;
+  std::string trace_file_;
   bool verbose_;
   size_t min_rules_;
   size_t random_seed_;
   size_t cut_algo_;
+  size_t jobs_;
+  bool separate_large_;
+  bool compact_regions_;
+  bool autotune_;
 
   size_t parse_int_param(const std::string& input,
       const std::string& param, const size_t min, const size_t max);
@@ -21,45 +21,67 @@ bool Box::operator==(const Box& other) const {
 void Box::cut(const size_t dimension, const size_t num_cuts,
     std::vector<Box>& result_boxes) const {
 
+  DimVector slices;
+  cut_slices(dimension, num_cuts, slices);
+  const size_t num_slices = slices.size();
+  for (size_t i = 0; i < num_slices; ++i)
+    result_boxes.push_back(piece(dimension, slices[i]));
+}
+
+
+void Box::unequal_cut(const size_t dimension,
+    const std::vector<dim_t>& cut_points,
+    std::vector<Box>& result_boxes) const {
+
+  DimVector slices;
+  unequal_cut_slices(dimension, cut_points, slices);
+  const size_t num_slices = slices.size();
+  for (size_t i = 0; i < num_slices; ++i)
+    result_boxes.push_back(piece(dimension, slices[i]));
+}
+
+
+void Box::cut_slices(const size_t dimension, const size_t num_cuts,
+    DimVector& slices) const {
+
   const DimTuple& bounds = box_bounds_[dimension];
   const dim_t start = std::get<0>(bounds);
   const dim_t end = std::get<1>(bounds);
   const size_t piece_len = (end - start) / (num_cuts + 1);
 
+  slices.clear();
   dim_t current_start = start;
   for (size_t i = 0; i < num_cuts; ++i) {
     const dim_t current_end = current_start + piece_len;
-    DimVector box_bounds(box_bounds_);
-    box_bounds[dimension] = std::make_tuple(current_start, current_end);
-    result_boxes.push_back(Box(box_bounds));
+    slices.push_back(std::make_tuple(current_start, current_end));
     current_start = current_end + 1;
   }
-  DimVector box_bounds(box_bounds_);
-  box_bounds[dimension] = std::make_tuple(current_start, end);
-  result_boxes.push_back(Box(box_bounds));
+  slices.push_back(std::make_tuple(current_start, end));
 }
 
 
-void Box::unequal_cut(const size_t dimension,
-    const std::vector<dim_t>& cut_points,
-    std::vector<Box>& result_boxes) const {
+void Box::unequal_cut_slices(const size_t dimension,
+    const std::vector<dim_t>& cut_points, DimVector& slices) const {
 
   dim_t start = std::get<0>(box_bounds_[dimension]);
   dim_t end = 0;
   const dim_t box_end = std::get<1>(box_bounds_[dimension]);
   const size_t num_cut_points = cut_points.size();
+  slices.clear();
   for (size_t i = 0; i < num_cut_points; ++i) {
     end = cut_points[i];
-    DimVector box_bounds(box_bounds_);
-    box_bounds[dimension] = std::make_tuple(start, end);
-    result_boxes.push_back(Box(box_bounds));
+    slices.push_back(std::make_tuple(start, end));
     start = end + 1;
   }
-  if (end < box_end) {
-    DimVector box_bounds(box_bounds_);
-    box_bounds[dimension] = std::make_tuple(start, box_end);
-    result_boxes.push_back(Box(box_bounds));
-  }
+  if (end < box_end)
+    slices.push_back(std::make_tuple(start, box_end));
+}
+
+
+Box Box::piece(const size_t dimension, const DimTuple& slice) const {
+  DimVector box_bounds(box_bounds_);
+  box_bounds[dimension] = slice;
+  return Box(box_bounds);
 }
 
 
@@ -26,6 +26,22 @@ public:
       const std::vector<dim_t>& cut_points,
       std::vector<Box>& result_boxes) const;
 
+  /*
+   * Describes the pieces of cut and unequal_cut without creating them: the
+   * pieces equal this box except for their slices of the cut dimension,
+   * which are stored in order.
+   */
+  void cut_slices(const size_t dimension, const size_t num_cuts,
+      DimVector& slices) const;
+
+  void unequal_cut_slices(const size_t dimension,
+      const std::vector<dim_t>& cut_points, DimVector& slices) const;
+
+  /*
+   * Creates the piece of this box with the given slice of a dimension.
+   */
+  Box piece(const size_t dimension, const DimTuple& slice) const;
+
   bool collide(const Box& other) const;
 
   static size_t num_distinct_boxes_in_dim(const size_t dimension,
@@ -0,0 +1,183 @@
+#include "collide.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HITABLES_X86_KERNELS 1
+#endif
+
+const size_t CollisionBlock::KERNEL_SCALAR = 0;
+const size_t CollisionBlock::KERNEL_SSE4 = 1;
+const size_t CollisionBlock::KERNEL_AVX2 = 2;
+
+/*
+ * Signature shared by all kernels.  They fill num_words 64-bit words of the
+ * mask; bounds and box coordinates have their sign bit flipped.
+ */
+typedef void (*CollisionKernel)(const int32_t* const* starts,
+    const int32_t* const* ends, const int32_t* box_starts,
+    const int32_t* box_ends, const size_t num_words, uint64_t* mask);
+
+
+static inline int32_t flip_sign(const dim_t value) {
+  return static_cast<int32_t>(value ^ 0x80000000u);
+}
+
+
+static void collide_scalar(const int32_t* const* starts,
+    const int32_t* const* ends, const int32_t* box_starts,
+    const int32_t* box_ends, const size_t num_words, uint64_t* mask) {
+
+  for (size_t w = 0; w < num_words; ++w) {
+    uint64_t word = 0;
+    for (size_t k = 0; k < 64; ++k) {
+      const size_t i = w * 64 + k;
+      bool hit = true;
+      for (size_t dim = 0; dim < RuleTable::NUM_DIMS; ++dim)
+        hit &= starts[dim][i] <= box_ends[dim]
+            && ends[dim][i] >= box_starts[dim];
+      word |= static_cast<uint64_t>(hit) << k;
+    }
+    mask[w] = word;
+  }
+}
+
+
+#ifdef HITABLES_X86_KERNELS
+
+__attribute__((target("sse4.1")))
+static void collide_sse4(const int32_t* const* starts,
+    const int32_t* const* ends, const int32_t* box_starts,
+    const int32_t* box_ends, const size_t num_words, uint64_t* mask) {
+
+  __m128i lo[RuleTable::NUM_DIMS];
+  __m128i hi[RuleTable::NUM_DIMS];
+  for (size_t dim = 0; dim < RuleTable::NUM_DIMS; ++dim) {
+    lo[dim] = _mm_set1_epi32(box_starts[dim]);
+    hi[dim] = _mm_set1_epi32(box_ends[dim]);
+  }
+  for (size_t w = 0; w < num_words; ++w) {
+    uint64_t word = 0;
+    for (size_t k = 0; k < 64; k += 4) {
+      const size_t i = w * 64 + k;
+      __m128i miss = _mm_setzero_si128();
+      for (size_t dim = 0; dim < RuleTable::NUM_DIMS; ++dim) {
+        const __m128i start = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(starts[dim] + i));
+        const __m128i end = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(ends[dim] + i));
+        miss = _mm_or_si128(miss, _mm_or_si128(_mm_cmpgt_epi32(start, hi[dim]),
+            _mm_cmpgt_epi32(lo[dim], end)));
+      }
+      const uint64_t bits = ~_mm_movemask_ps(_mm_castsi128_ps(miss)) & 0xf;
+      word |= bits << k;
+    }
+    mask[w] = word;
+  }
+}
+
+
+__attribute__((target("avx2")))
+static void collide_avx2(const int32_t* const* starts,
+    const int32_t* const* ends, const int32_t* box_starts,
+    const int32_t* box_ends, const size_t num_words, uint64_t* mask) {
+
+  __m256i lo[RuleTable::NUM_DIMS];
+  __m256i hi[RuleTable::NUM_DIMS];
+  for (size_t dim = 0; dim < RuleTable::NUM_DIMS; ++dim) {
+    lo[dim] = _mm256_set1_epi32(box_starts[dim]);
+    hi[dim] = _mm256_set1_epi32(box_ends[dim]);
+  }
+  for (size_t w = 0; w < num_words; ++w) {
+    uint64_t word = 0;
+    for (size_t k = 0; k < 64; k += 8) {
+      const size_t i = w * 64 + k;
+      __m256i miss = _mm256_setzero_si256();
+      for (size_t dim = 0; dim < RuleTable::NUM_DIMS; ++dim) {
+        const __m256i start = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(starts[dim] + i));
+        const __m256i end = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(ends[dim] + i));
+        miss = _mm256_or_si256(miss, _mm256_or_si256(
+            _mm256_cmpgt_epi32(start, hi[dim]),
+            _mm256_cmpgt_epi32(lo[dim], end)));
+      }
+      const uint64_t bits =
+          ~_mm256_movemask_ps(_mm256_castsi256_ps(miss)) & 0xff;
+      word |= bits << k;
+    }
+    mask[w] = word;
+  }
+}
+
+#endif // HITABLES_X86_KERNELS
+
+
+CollisionBlock::CollisionBlock(const RuleTable& table,
+    const RuleIdVector& ids) : size_(ids.size()) {
+
+  const size_t padded_size = num_words() * 64;
+  for (size_t dim = 0; dim < RuleTable::NUM_DIMS; ++dim) {
+    starts_[dim].resize(padded_size, INT32_MAX);
+    ends_[dim].resize(padded_size, INT32_MIN);
+    for (size_t i = 0; i < size_; ++i) {
+      starts_[dim][i] = flip_sign(table.start(dim, ids[i]));
+      ends_[dim][i] = flip_sign(table.end(dim, ids[i]));
+    }
+  }
+}
+
+
+bool CollisionBlock::supports(const size_t kernel) {
+  if (kernel == KERNEL_SCALAR)
+    return true;
+#ifdef HITABLES_X86_KERNELS
+  __builtin_cpu_init();
+  if (kernel == KERNEL_SSE4)
+    return __builtin_cpu_supports("sse4.1");
+  if (kernel == KERNEL_AVX2)
+    return __builtin_cpu_supports("avx2");
+#endif
+  return false;
+}
+
+
+size_t CollisionBlock::best_kernel() {
+  static const size_t best = supports(KERNEL_AVX2) ? KERNEL_AVX2
+                           : supports(KERNEL_SSE4) ? KERNEL_SSE4
+                           : KERNEL_SCALAR;
+  return best;
+}
+
+
+void CollisionBlock::collide(const TableBox& box, std::vector<uint64_t>& mask,
+    const size_t kernel) const {
+
+  CollisionKernel function = collide_scalar;
+#ifdef HITABLES_X86_KERNELS
+  if (kernel == KERNEL_SSE4)
+    function = collide_sse4;
+  else if (kernel == KERNEL_AVX2)
+    function = collide_avx2;
+#endif
+  if (kernel != best_kernel() && !supports(kernel))
+    throw std::string("Collision kernel not supported by this processor!");
+  const int32_t* starts[RuleTable::NUM_DIMS];
+  const int32_t* ends[RuleTable::NUM_DIMS];
+  int32_t box_starts[RuleTable::NUM_DIMS];
+  int32_t box_ends[RuleTable::NUM_DIMS];
+  for (size_t dim = 0; dim < RuleTable::NUM_DIMS; ++dim) {
+    starts[dim] = starts_[dim].data();
+    ends[dim] = ends_[dim].data();
+    box_starts[dim] = flip_sign(box.start(dim));
+    box_ends[dim] = flip_sign(box.end(dim));
+  }
+  const size_t words = num_words();
+  mask.resize(words);
+  if (words == 0)
+    return;
+  function(starts, ends, box_starts, box_ends, words, mask.data());
+  // the padding may collide with a box that spans a whole dimension
+  const size_t tail = size_ % 64;
+  if (tail != 0)
+    mask[words - 1] &= (1ULL << tail) - 1;
+}
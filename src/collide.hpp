@@ -0,0 +1,61 @@
+#ifndef HITABLES_COLLIDE_HPP
+#define HITABLES_COLLIDE_HPP 1
+
+#include <cstdlib>
+#include <vector>
+#include "ruletable.hpp"
+
+/*
+ * The bounds of a node's rules copied into one contiguous block per
+ * dimension, so that a child box can be tested against all of them with
+ * vector instructions.  The result is a bitmask with bit i set if the i-th
+ * rule of the block collides with the box.
+ * The kernel is picked at run time: AVX2 tests 8 rules per compare, SSE4.1
+ * tests 4, and the scalar kernel serves all other processors.
+ */
+class CollisionBlock {
+public:
+  static const size_t KERNEL_SCALAR;
+  static const size_t KERNEL_SSE4;
+  static const size_t KERNEL_AVX2;
+
+  CollisionBlock(const RuleTable& table, const RuleIdVector& ids);
+
+  /*
+   * Computes the collision bitmask of the given box with the best kernel
+   * the processor supports.
+   */
+  inline void collide(const TableBox& box, std::vector<uint64_t>& mask) const {
+    collide(box, mask, best_kernel());
+  }
+
+  /*
+   * Computes the collision bitmask of the given box with the given kernel,
+   * which must be supported; throws an error message otherwise.
+   */
+  void collide(const TableBox& box, std::vector<uint64_t>& mask,
+      const size_t kernel) const;
+
+  /*
+   * Determines the fastest kernel the processor supports.
+   */
+  static size_t best_kernel();
+
+  /*
+   * Checks whether the processor supports the given kernel.
+   */
+  static bool supports(const size_t kernel);
+
+  inline size_t size() const {return size_;}
+
+  inline size_t num_words() const {return (size_ + 63) / 64;}
+
+private:
+  size_t size_;
+  // bounds with their sign bit flipped, so that signed comparisons order
+  // them like unsigned ones; the blocks are padded to a multiple of 64
+  std::vector<int32_t> starts_[RuleTable::NUM_DIMS];
+  std::vector<int32_t> ends_[RuleTable::NUM_DIMS];
+};
+
+#endif // HITABLES_COLLIDE_HPP
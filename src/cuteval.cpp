@@ -0,0 +1,179 @@
+#include "cuteval.hpp"
+#include <algorithm>
+#include <cmath>
+
+CutEvaluator::CutEvaluator(const Box& box, const RuleTable& table,
+    const RuleIdVector& ids, const size_t dimension)
+    : dimension_(dimension),
+    box_start_(std::get<0>(box.box_bounds()[dimension])),
+    box_end_(std::get<1>(box.box_bounds()[dimension])) {
+
+  const size_t num_rules = ids.size();
+  std::vector<DimTuple> intervals;
+  intervals.reserve(num_rules);
+  for (size_t i = 0; i < num_rules; ++i)
+    intervals.push_back(std::make_tuple(table.start(dimension, ids[i]),
+        table.end(dimension, ids[i])));
+  std::sort(intervals.begin(), intervals.end());
+  starts_.reserve(num_rules);
+  ends_by_start_.reserve(num_rules);
+  for (size_t i = 0; i < num_rules; ++i) {
+    starts_.push_back(std::get<0>(intervals[i]));
+    ends_by_start_.push_back(std::get<1>(intervals[i]));
+  }
+  ends_ = ends_by_start_;
+  std::sort(ends_.begin(), ends_.end());
+}
+
+
+CutEvaluator::CutEvaluator(const Box& box, const RuleTable& table,
+    const RuleIdVector& ids, const PositionVector& by_start,
+    const PositionVector& by_end, const size_t dimension)
+    : dimension_(dimension),
+    box_start_(std::get<0>(box.box_bounds()[dimension])),
+    box_end_(std::get<1>(box.box_bounds()[dimension])) {
+
+  const size_t num_rules = ids.size();
+  starts_.reserve(num_rules);
+  ends_.reserve(num_rules);
+  ends_by_start_.reserve(num_rules);
+  for (size_t i = 0; i < num_rules; ++i) {
+    starts_.push_back(table.start(dimension, ids[by_start[i]]));
+    ends_.push_back(table.end(dimension, ids[by_end[i]]));
+    ends_by_start_.push_back(table.end(dimension, ids[by_start[i]]));
+  }
+}
+
+
+void CutEvaluator::child_rule_counts(const size_t num_cuts,
+    std::vector<size_t>& counts) const {
+
+  counts.clear();
+  visit_child_rule_counts(num_cuts,
+      [&counts] (const size_t count) {counts.push_back(count);});
+}
+
+
+size_t CutEvaluator::space_measure(const size_t num_cuts) const {
+  size_t space_measure = 0;
+  visit_child_rule_counts(num_cuts,
+      [&space_measure] (const size_t count) {space_measure += count;});
+  space_measure += (num_cuts == 0 ? 0 : num_cuts + 1);
+  return space_measure;
+}
+
+
+size_t CutEvaluator::max_rules_per_child(const size_t num_cuts) const {
+  size_t max_rules = 0;
+  visit_child_rule_counts(num_cuts, [&max_rules] (const size_t count) {
+    max_rules = max_rules < count ? count : max_rules;
+  });
+  return max_rules;
+}
+
+
+size_t CutEvaluator::num_common_rules(const size_t num_cuts) const {
+  size_t first = num_cuts + 1;
+  size_t last = 0;
+  size_t i = 0;
+  visit_child_rule_counts(num_cuts, [&first, &last, &i] (const size_t count) {
+    if (count > 0) {
+      first = first > i ? i : first;
+      last = i;
+    }
+    ++i;
+  });
+  if (first > num_cuts)
+    return 0;
+  // the common rules overlap the first and the last non-empty child
+  const uint64_t piece_len = (box_end_ - box_start_) / (num_cuts + 1);
+  const uint64_t first_end = first < num_cuts
+      ? box_start_ + first * (piece_len + 1) + piece_len : box_end_;
+  const uint64_t last_start = box_start_ + last * (piece_len + 1);
+  const size_t num_rules = starts_.size();
+  size_t num_common = 0;
+  for (size_t k = 0; k < num_rules && starts_[k] <= first_end; ++k)
+    if (ends_by_start_[k] >= last_start)
+      ++num_common;
+  return num_common;
+}
+
+
+double CutEvaluator::dispatch_evaluations(const size_t num_children) {
+  if (num_children <= 2)
+    return num_children;
+  return 2 * std::ceil(std::log2(num_children)) + 1;
+}
+
+
+/*
+ * Rules evaluated below a child holding num_rules rules.
+ */
+static double subtree_evaluations(const size_t num_rules,
+    const size_t binth) {
+
+  if (num_rules <= binth)
+    return num_rules + 1;
+  const double num_leaves = std::ceil(double(num_rules) / binth);
+  return 2 * std::ceil(std::log2(num_leaves)) + binth + 1;
+}
+
+
+void CutEvaluator::set_packets(const PacketSet& packets) {
+  std::vector<uint32_t> positions;
+  packets.sort_by(dimension_, positions);
+  const size_t num_packets = positions.size();
+  packet_coordinates_.resize(num_packets);
+  packet_weight_sums_.resize(num_packets);
+  size_t weight_sum = 0;
+  for (size_t i = 0; i < num_packets; ++i) {
+    packet_coordinates_[i] = packets.coordinate(positions[i], dimension_);
+    weight_sum += packets.weight(positions[i]);
+    packet_weight_sums_[i] = weight_sum;
+  }
+}
+
+
+void CutEvaluator::child_shares(const size_t num_cuts,
+    std::vector<double>& shares) const {
+
+  shares.assign(num_cuts + 1, 1.0 / (num_cuts + 1));
+  const size_t num_packets = packet_coordinates_.size();
+  if (num_packets == 0)
+    return;
+  const double total_weight = packet_weight_sums_.back();
+  const uint64_t piece_len = (box_end_ - box_start_) / (num_cuts + 1);
+  uint64_t hi = box_start_ + piece_len;
+  size_t num_below = 0;
+  size_t weight_below = 0;
+  for (size_t i = 0; i <= num_cuts; ++i) {
+    if (i == num_cuts)
+      hi = box_end_;
+    while (num_below < num_packets && packet_coordinates_[num_below] <= hi)
+      ++num_below;
+    const size_t weight_sum = num_below == 0
+        ? 0 : packet_weight_sums_[num_below - 1];
+    shares[i] = (weight_sum - weight_below) / total_weight;
+    weight_below = weight_sum;
+    hi += piece_len + 1;
+  }
+}
+
+
+double CutEvaluator::expected_evaluations(const size_t num_cuts,
+    const size_t binth) const {
+
+  std::vector<double> shares;
+  child_shares(num_cuts, shares);
+  const size_t num_common = num_common_rules(num_cuts);
+  size_t num_children = 0;
+  size_t i = 0;
+  double below = 0;
+  visit_child_rule_counts(num_cuts, [&] (const size_t count) {
+    if (count > 0)
+      ++num_children;
+    below += shares[i++]
+        * subtree_evaluations(count > 0 ? count - num_common : 0, binth);
+  });
+  return num_common + dispatch_evaluations(num_children) + below;
+}
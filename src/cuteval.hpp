@@ -0,0 +1,137 @@
+#ifndef HITABLES_CUTEVAL_HPP
+#define HITABLES_CUTEVAL_HPP 1
+
+#include <cstdlib>
+#include <vector>
+#include "ruletable.hpp"
+#include "trace.hpp"
+
+/*
+ * Evaluates equidistant cuts of a tree node along one dimension without
+ * creating the children.  The rules' interval start and end points in that
+ * dimension are sorted once; the number of rules per child of any candidate
+ * cut is then obtained in a single sweep over the child boundaries:
+ * a child [lo, hi] holds all rules starting at or before hi minus those that
+ * ended before lo.
+ * The counts are taken before redundancy elimination within the children, so
+ * they are an upper bound of what TreeNode::cut produces.
+ */
+class CutEvaluator {
+public:
+  CutEvaluator(const Box& box, const RuleTable& table,
+      const RuleIdVector& ids, const size_t dimension);
+
+  /*
+   * Takes the positions within ids of the rules sorted by interval start and
+   * by interval end point in the given dimension, which saves sorting.
+   */
+  CutEvaluator(const Box& box, const RuleTable& table,
+      const RuleIdVector& ids, const PositionVector& by_start,
+      const PositionVector& by_end, const size_t dimension);
+
+  /*
+   * Computes the number of rules in each of the num_cuts + 1 children that
+   * Box::cut produces when cutting num_cuts times.
+   */
+  void child_rule_counts(const size_t num_cuts,
+      std::vector<size_t>& counts) const;
+
+  /*
+   * Computes the HiCuts space measure of cutting num_cuts times.
+   */
+  size_t space_measure(const size_t num_cuts) const;
+
+  /*
+   * Computes the number of rules in the largest child when cutting num_cuts
+   * times.
+   */
+  size_t max_rules_per_child(const size_t num_cuts) const;
+
+  /*
+   * Computes the number of rules held by every non-empty child when cutting
+   * num_cuts times.  TreeNode pushes these rules up to the node, where they
+   * are matched before the dispatch.
+   */
+  size_t num_common_rules(const size_t num_cuts) const;
+
+  /*
+   * Makes expected_evaluations weight the children by the share of the given
+   * packets that falls into them instead of by their width.  The packets
+   * must lie within the box.
+   */
+  void set_packets(const PacketSet& packets);
+
+  /*
+   * Estimates the number of rules a packet traverses in the emitted chains
+   * when cutting num_cuts times, assuming packets spread evenly over the box
+   * unless set_packets has been called:
+   * the rules common to all children, the binary dispatch to the non-empty
+   * children and the expected cost below the child the packet lands in.
+   * A child of at most binth rules is a leaf scanned up to its fall-through
+   * jump; larger children are assumed to be dispatched further down to
+   * leaves of binth rules.
+   */
+  double expected_evaluations(const size_t num_cuts, const size_t binth) const;
+
+  /*
+   * Number of rules evaluated by the binary dispatch to num_children
+   * children: each level tests the lower half and jumps to the upper one, and
+   * more than two children take an extra range test in front of the search.
+   */
+  static double dispatch_evaluations(const size_t num_children);
+
+  inline size_t dimension() const {return dimension_;}
+
+private:
+  size_t dimension_;
+  dim_t box_start_;
+  dim_t box_end_;
+  std::vector<dim_t> starts_;
+  std::vector<dim_t> ends_;
+  // the end points in the order of starts_
+  std::vector<dim_t> ends_by_start_;
+  // the observed packets' coordinates in ascending order and the sums of
+  // their weights up to each of them
+  std::vector<dim_t> packet_coordinates_;
+  std::vector<size_t> packet_weight_sums_;
+
+  /*
+   * Computes the share of packets that each child gets when cutting num_cuts
+   * times.
+   */
+  void child_shares(const size_t num_cuts, std::vector<double>& shares) const;
+
+  /*
+   * Calls visit with the number of rules of each child in order, without
+   * allocating.
+   */
+  template <typename Visit>
+  void visit_child_rule_counts(const size_t num_cuts, Visit visit) const;
+};
+
+
+template <typename Visit>
+void CutEvaluator::visit_child_rule_counts(const size_t num_cuts,
+    Visit visit) const {
+
+  const size_t num_rules = starts_.size();
+  // mirror the piece boundaries of Box::cut; 64 bit arithmetic keeps pieces
+  // beyond the end of the address space from wrapping around
+  const uint64_t piece_len = (box_end_ - box_start_) / (num_cuts + 1);
+  uint64_t lo = box_start_;
+  size_t num_started = 0;
+  size_t num_ended = 0;
+  for (size_t i = 0; i <= num_cuts; ++i) {
+    const uint64_t hi = i < num_cuts ? lo + piece_len : box_end_;
+    while (num_started < num_rules && starts_[num_started] <= hi)
+      ++num_started;
+    while (num_ended < num_rules && ends_[num_ended] < lo)
+      ++num_ended;
+    // every rule of the node starts at or before the end of the node's box,
+    // so the rules that ended before lo are among those that started
+    visit(num_started - num_ended);
+    lo += piece_len + 1;
+  }
+}
+
+#endif // HITABLES_CUTEVAL_HPP
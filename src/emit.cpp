@@ -1,19 +1,35 @@
 #include "emit.hpp"
+#include <cstring>
 
 /* prototypes */
 
 static void emit_binary_port_dispatch(TreeNode* node, const std::string& chain,
     const size_t tree_id, const size_t chain_count, const std::string& flag,
-    const size_t cut_dim, std::stringstream& out, StrVector& chains);
+    const size_t cut_dim, std::ostream& out, StrVector& chains);
 
 static void emit_binary_ip_dispatch(TreeNode* node, const std::string& chain,
     const size_t tree_id, const size_t chain_count, const std::string& flag,
-    const size_t cut_dim, std::stringstream& out, StrVector& chains);
+    const size_t cut_dim, std::ostream& out, StrVector& chains);
 
 static void emit_port_lookup(const std::string& search_chain,
     const std::string& target_chain, const std::string& flag,
     const TreeNode& lookup_child, const size_t cut_dim,
-    const Box& bounding_box, std::stringstream& out);
+    const Box& bounding_box, std::ostream& out);
+
+static void emit_multi_field_dispatch(TreeNode* node, const std::string& chain,
+    const size_t tree_id, const size_t chain_count, std::ostream& out,
+    StrVector& chains);
+
+static void emit_split_dispatch(TreeNode* node, const std::string& chain,
+    const size_t tree_id, const size_t chain_count, std::ostream& out,
+    StrVector& chains);
+
+static void emit_field_matches(const std::string& prot,
+    const std::vector<size_t>& dims, const DimVector& bounds,
+    const size_t num_fields, std::ostream& out);
+
+static void child_packet_weights(const TreeNode* node,
+    std::vector<size_t>& weights);
 
 /* implementation */
 
@@ -50,7 +66,7 @@ bool is_builtin_chain(const std::string& chain) {
 }
 
 
-void Emitter::emit(std::stringstream& out, StrVector& chains,
+void Emitter::emit(std::ostream& out, StrVector& chains,
     const DefaultPolicies& policies) {
 
   const size_t num_rules = rules_.size();
@@ -103,9 +119,10 @@ void Emitter::emit(std::stringstream& out, StrVector& chains,
 void Emitter::emit_tree(TreeNode* tree,
     const std::string& chain, const size_t tree_id,
     const std::string& next_chain, const bool leaf_jump,
-    std::stringstream& out, StrVector& chains) {
+    std::ostream& out, StrVector& chains) {
 
   tree->compute_numbering();
+  tree->share_leaf_ids();
   std::string start_chain(build_tree_chain_name(chain, tree_id, tree->id()));
   out << "# Tree " << tree_id << " for Chain " << chain << std::endl;
   out << "-A " << chain << " -p " << tree->prot() 
@@ -113,36 +130,59 @@ void Emitter::emit_tree(TreeNode* tree,
   // default bail out to next chain if packet does not match tree
   out << "-A " << chain << " -j " << next_chain << std::endl;
 
+  const size_t first_chain = chains.size();
   chains.push_back(start_chain);
   NodeRefQueue node_fifo;
   node_fifo.push(tree);
+  std::unordered_set<size_t> emitted_leaves;
 
   while (!node_fifo.empty()) {
     TreeNode* node = node_fifo.front();
     node_fifo.pop();
-    if (node->is_leaf())
-      emit_leaf(node, build_tree_chain_name(chain, tree_id, node->id()),
-          next_chain, leaf_jump, out);
-    else {
+    if (node->is_leaf()) {
+      // leaves with the same rules share the chain of the first of them
+      if (emitted_leaves.insert(node->id()).second)
+        emit_leaf(node, build_tree_chain_name(chain, tree_id, node->id()),
+            next_chain, leaf_jump, out);
+    } else {
+      // match the rules common to all children before dispatching to them
+      emit_pushed_rules(node, build_tree_chain_name(chain, tree_id,
+          node->id()), out);
       // emit the dispatch to child nodes
       emit_simple_binary_dispatch(node, chain, tree_id, node->id(), out,
           chains);
       // now ensure that all children of this node are traversed
-      NodeVector& children = node->children();
-      const size_t num_children = children.size();
+      const size_t num_children = node->num_children();
       for (size_t i = 0; i < num_children; ++i) {
-        node_fifo.push(&children[i]);
+        node_fifo.push(&node->child(i));
       }
     }
   }
+  // declare every shared chain once
+  std::unordered_set<std::string> declared;
+  size_t num_declared = first_chain;
+  for (size_t i = first_chain; i < chains.size(); ++i)
+    if (declared.insert(chains[i]).second)
+      chains[num_declared++] = chains[i];
+  chains.resize(num_declared);
   out << std::endl;
 }
 
 
 void Emitter::emit_simple_binary_dispatch(TreeNode* node,
     const std::string& chain, const size_t tree_id,
-    const size_t chain_count, std::stringstream& out, StrVector& chains) {
+    const size_t chain_count, std::ostream& out, StrVector& chains) {
 
+  // nodes of a hyper cut dispatch on all cut dimensions at once
+  if (__builtin_popcount(node->cut_dims()) > 1) {
+    emit_multi_field_dispatch(node, chain, tree_id, chain_count, out, chains);
+    return;
+  }
+  // the two halves of a HyperSplit node need one range test
+  if (node->is_split()) {
+    emit_split_dispatch(node, chain, tree_id, chain_count, out, chains);
+    return;
+  }
   const size_t cut_dim = node->cut_dim();
   switch (cut_dim) {
     // src port
@@ -170,14 +210,15 @@ void Emitter::emit_simple_binary_dispatch(TreeNode* node,
 
 static void emit_binary_port_dispatch(TreeNode* node, const std::string& chain,
     const size_t tree_id, const size_t chain_count, const std::string& flag,
-    const size_t cut_dim, std::stringstream& out, StrVector& chains) {
+    const size_t cut_dim, std::ostream& out, StrVector& chains) {
 
   std::string search_chain(build_tree_chain_name(chain, tree_id, chain_count));
   std::string current_chain(search_chain);
   out << "# Binary search on " << flag << ", chain " << chain << std::endl;
-  BinSearchTree bin_tree(0, node->num_children() - 1);
+  std::vector<size_t> weights;
+  child_packet_weights(node, weights);
+  BinSearchTree bin_tree(0, node->num_children() - 1, weights);
   bool at_first_search_node = true;
-  NodeVector& hicuts_children = node->children();
 
   std::queue<const BinSearchTree*> fifo;
   fifo.push(&bin_tree);
@@ -190,7 +231,7 @@ static void emit_binary_port_dispatch(TreeNode* node, const std::string& chain,
     if (bin_node->is_leaf()) {
       // base case => forward to next HiCuts node
       std::string target_chain(build_tree_chain_name(chain, tree_id,
-          hicuts_children[lookup_index].id()));
+          node->child(lookup_index).id()));
       chains.push_back(target_chain);
       out << "# binary search leaf node" << std::endl;
       out << "-A " << search_chain
@@ -198,7 +239,7 @@ static void emit_binary_port_dispatch(TreeNode* node, const std::string& chain,
     } else {
       // perform the binary dispatch
       // emit test on the lookup HiCuts node
-      const TreeNode& lookup_child = hicuts_children[lookup_index];
+      const TreeNode& lookup_child = node->child(lookup_index);
       std::string target_chain(
           build_tree_chain_name(chain, tree_id, lookup_child.id()));
       chains.push_back(target_chain);
@@ -217,8 +258,7 @@ static void emit_binary_port_dispatch(TreeNode* node, const std::string& chain,
         target_chain = build_bin_search_name(chain, tree_id, chain_count,
             left_node->lookup_index());
         chains.push_back(target_chain);
-        Box bbox(TreeNode::minimal_bounding_box(hicuts_children,
-            left_node->borders()));
+        Box bbox(node->children_bounding_box(left_node->borders()));
         out << "# binary search left branch" << std::endl;
         emit_port_lookup(search_chain, target_chain, flag, lookup_child,
             cut_dim, bbox, out);
@@ -250,14 +290,15 @@ static void emit_binary_port_dispatch(TreeNode* node, const std::string& chain,
 
 static void emit_binary_ip_dispatch(TreeNode* node, const std::string& chain,
     const size_t tree_id, const size_t chain_count, const std::string& flag,
-    const size_t cut_dim, std::stringstream& out, StrVector& chains) {
+    const size_t cut_dim, std::ostream& out, StrVector& chains) {
 
   std::string search_chain(build_tree_chain_name(chain, tree_id, chain_count));
   std::string current_chain(search_chain);
   out << "# Binary search on " << flag << ", chain " << chain << std::endl;
-  BinSearchTree bin_tree(0, node->num_children() - 1);
+  std::vector<size_t> weights;
+  child_packet_weights(node, weights);
+  BinSearchTree bin_tree(0, node->num_children() - 1, weights);
   bool at_first_search_node = true;
-  NodeVector& hicuts_children = node->children();
 
   std::queue<const BinSearchTree*> fifo;
   fifo.push(&bin_tree);
@@ -270,7 +311,7 @@ static void emit_binary_ip_dispatch(TreeNode* node, const std::string& chain,
     if (bin_node->is_leaf()) {
       // base case => forward to next HiCuts node
       std::string target_chain(build_tree_chain_name(chain,
-          tree_id, hicuts_children[lookup_index].id()));
+          tree_id, node->child(lookup_index).id()));
       chains.push_back(target_chain);
       out << "# binary search leaf node" << std::endl;
       out << "-A " << search_chain
@@ -279,7 +320,7 @@ static void emit_binary_ip_dispatch(TreeNode* node, const std::string& chain,
       // perform the binary dispatch
       // emit test on the lookup HiCuts node
       out << "# check if binary search terminates" << std::endl;
-      const TreeNode& lookup_child = hicuts_children[lookup_index];
+      const TreeNode& lookup_child = node->child(lookup_index);
       std::string target_chain(
           build_tree_chain_name(chain, tree_id, lookup_child.id()));
       chains.push_back(target_chain);
@@ -298,8 +339,7 @@ static void emit_binary_ip_dispatch(TreeNode* node, const std::string& chain,
         target_chain = build_bin_search_name(chain, tree_id, chain_count,
             left_node->lookup_index());
         chains.push_back(target_chain);
-        Box bbox(TreeNode::minimal_bounding_box(hicuts_children,
-            left_node->borders()));
+        Box bbox(node->children_bounding_box(left_node->borders()));
         out << "-A " << search_chain
             << " -m iprange "
             << " --" << flag << "-range "
@@ -328,17 +368,192 @@ static void emit_binary_ip_dispatch(TreeNode* node, const std::string& chain,
 }
 
 
+/*
+ * Maximum number of children that a multi-field dispatch matches one after
+ * the other instead of searching on.
+ */
+static const size_t DIRECT_DISPATCH_MAX_CHILDREN = 4;
+
+
+static void emit_multi_field_dispatch(TreeNode* node, const std::string& chain,
+    const size_t tree_id, const size_t chain_count, std::ostream& out,
+    StrVector& chains) {
+
+  std::vector<size_t> dims;
+  for (size_t dim = 0; dim < 32; ++dim)
+    if ((node->cut_dims() >> dim) & 1)
+      dims.push_back(dim);
+  const size_t num_cut_dims = dims.size();
+  const DimVector& node_bounds = node->box().box_bounds();
+  const std::string prot(node->prot());
+  std::string search_chain(build_tree_chain_name(chain, tree_id, chain_count));
+  std::string current_chain(search_chain);
+  out << "# Multi-field binary search, chain " << chain << std::endl;
+  std::vector<size_t> weights;
+  child_packet_weights(node, weights);
+  BinSearchTree bin_tree(0, node->num_children() - 1, weights);
+  bool at_first_search_node = true;
+
+  std::queue<const BinSearchTree*> fifo;
+  fifo.push(&bin_tree);
+  while (!fifo.empty()) {
+    const BinSearchTree* bin_node = fifo.front();
+    fifo.pop();
+    const size_t lookup_index = bin_node->lookup_index();
+    if (!at_first_search_node)
+      search_chain = build_chain_name(current_chain, lookup_index);
+    if (bin_node->end() - bin_node->start() < DIRECT_DISPATCH_MAX_CHILDREN) {
+      // base case => forward to the next HiCuts nodes by matching their cells
+      // directly, which saves the jumps of the remaining search levels
+      out << "# direct dispatch" << std::endl;
+      for (size_t i = bin_node->start(); i <= bin_node->end(); ++i) {
+        const TreeNode& target_child = node->child(i);
+        std::string target_chain(build_tree_chain_name(chain, tree_id,
+            target_child.id()));
+        chains.push_back(target_chain);
+        out << "-A " << search_chain;
+        if (i < bin_node->end())
+          emit_field_matches(prot, dims, target_child.box().box_bounds(),
+              num_cut_dims, out);
+        out << " -j " << target_chain << std::endl;
+      }
+    } else {
+      // emit test on the lookup HiCuts node, whose cell is matched on all cut
+      // fields at once
+      out << "# check if binary search terminates" << std::endl;
+      const TreeNode& lookup_child = node->child(lookup_index);
+      const DimVector& lookup_bounds = lookup_child.box().box_bounds();
+      std::string target_chain(
+          build_tree_chain_name(chain, tree_id, lookup_child.id()));
+      chains.push_back(target_chain);
+      out << "-A " << search_chain;
+      emit_field_matches(prot, dims, lookup_bounds, num_cut_dims, out);
+      out << " -j " << target_chain << std::endl;
+      // the children are ordered lexicographically by their cells, so the
+      // left branch takes the packets whose cell precedes the lookup cell:
+      // those that agree with it on the first k fields and lie below it in
+      // the next one
+      if (bin_node->has_left_child()) {
+        out << "# binary search left branch" << std::endl;
+        const BinSearchTree* left_node = bin_node->left();
+        target_chain = build_bin_search_name(chain, tree_id, chain_count,
+            left_node->lookup_index());
+        chains.push_back(target_chain);
+        DimVector bounds(lookup_bounds);
+        for (size_t k = 0; k < num_cut_dims; ++k) {
+          const size_t dim = dims[k];
+          const dim_t node_start = std::get<0>(node_bounds[dim]);
+          const dim_t lookup_start = std::get<0>(lookup_bounds[dim]);
+          if (lookup_start > node_start) {
+            bounds[dim] = std::make_tuple(node_start, lookup_start - 1);
+            out << "-A " << search_chain;
+            emit_field_matches(prot, dims, bounds, k + 1, out);
+            out << " -j " << target_chain << std::endl;
+          }
+          bounds[dim] = lookup_bounds[dim];
+        }
+        // ensure that the search continues on the left child
+        fifo.push(bin_node->left());
+      }
+      // forward to right child
+      out << "# binary search right branch" << std::endl;
+      const BinSearchTree* right_node = bin_node->right();
+      target_chain = build_bin_search_name(chain, tree_id, chain_count,
+          right_node->lookup_index());
+      chains.push_back(target_chain);
+      out << "-A " << search_chain
+          << " -j " << target_chain << std::endl;
+      // ensure that the search continues on the right child
+      fifo.push(bin_node->right());
+    }
+    at_first_search_node = false;
+  }
+  out << std::endl;
+}
+
+
+static void emit_split_dispatch(TreeNode* node, const std::string& chain,
+    const size_t tree_id, const size_t chain_count, std::ostream& out,
+    StrVector& chains) {
+
+  const std::vector<size_t> dims(1, node->cut_dim());
+  const std::string search_chain(
+      build_tree_chain_name(chain, tree_id, chain_count));
+  out << "# Split, chain " << chain << std::endl;
+  // packets in the range of the first child tested go there, all others to
+  // the other one; the child that observed more packets is tested first
+  const size_t first = node->child(1).packet_weight()
+      > node->child(0).packet_weight() ? 1 : 0;
+  for (size_t k = 0; k < 2; ++k) {
+    const TreeNode& target_child = node->child(k == 0 ? first : 1 - first);
+    std::string target_chain(build_tree_chain_name(chain, tree_id,
+        target_child.id()));
+    chains.push_back(target_chain);
+    out << "-A " << search_chain;
+    if (k == 0)
+      emit_field_matches(node->prot(), dims, target_child.box().box_bounds(),
+          1, out);
+    out << " -j " << target_chain << std::endl;
+  }
+  out << std::endl;
+}
+
+
+static void emit_field_matches(const std::string& prot,
+    const std::vector<size_t>& dims, const DimVector& bounds,
+    const size_t num_fields, std::ostream& out) {
+
+  static const char* port_flags[] = {"sport", "dport"};
+  static const char* ip_flags[] = {"src", "dst"};
+  bool have_prot = false;
+  bool have_iprange = false;
+  for (size_t k = 0; k < num_fields; ++k) {
+    const size_t dim = dims[k];
+    const dim_t start = std::get<0>(bounds[dim]);
+    const dim_t end = std::get<1>(bounds[dim]);
+    if (dim < 2) {
+      if (!have_prot)
+        out << " -p " << prot;
+      have_prot = true;
+      out << " --" << port_flags[dim] << " " << start << ":" << end;
+    } else {
+      if (!have_iprange)
+        out << " -m iprange";
+      have_iprange = true;
+      out << " --" << ip_flags[dim - 2] << "-range "
+          << Emitter::num_to_ip(start) << "-" << Emitter::num_to_ip(end);
+    }
+  }
+}
+
+
+void Emitter::emit_pushed_rules(const TreeNode* node,
+    const std::string& current_chain, std::ostream& out) {
+
+  if (node->pushed_rule_ids().empty())
+    return;
+  const std::vector<const Rule*> rules(node->pushed_rules());
+  out << "# pushed rules" << std::endl;
+  for (size_t i = 0; i < rules.size(); ++i) {
+    rules[i]->write_with_patched_chain(out, current_chain);
+    out << std::endl;
+  }
+}
+
+
 void Emitter::emit_leaf(const TreeNode* node, const std::string& current_chain,
     const std::string& next_chain, const bool leaf_jump,
-    std::stringstream& out) {
+    std::ostream& out) {
   
-  const size_t num_rules = node->num_rules();
-  if (num_rules == 0)
+  // a leaf whose rules have all been pushed up still has to bail out
+  if (node->num_rules() == 0 && !leaf_jump)
     return;
+  const std::vector<const Rule*> rules(node->rules());
+  const size_t num_rules = rules.size();
   out << "# leaf node" << std::endl;
   for (size_t i = 0; i < num_rules; ++i) {
-    out << node->rules()[i]->src_with_patched_chain(current_chain)
-        << std::endl;
+    rules[i]->write_with_patched_chain(out, current_chain);
+    out << std::endl;
   }
   if (leaf_jump)
     out << "-A " << current_chain << " -j " << next_chain << std::endl;
@@ -349,7 +564,7 @@ void Emitter::emit_leaf(const TreeNode* node, const std::string& current_chain,
 static void emit_port_lookup(const std::string& search_chain,
     const std::string& target_chain, const std::string& flag,
     const TreeNode& lookup_child, const size_t cut_dim,
-    const Box& bounding_box, std::stringstream& out) {
+    const Box& bounding_box, std::ostream& out) {
   
   out << "-A " << search_chain 
       << " -p " << lookup_child.prot()
@@ -395,7 +610,7 @@ void Emitter::emit_suffix(std::ofstream& out) {
 
 
 void Emitter::emit_custom_default_rule(const std::string& chain,
-    const ActionCode code, std::stringstream& out) {
+    const ActionCode code, std::ostream& out) {
 
   out << "-A " << chain << " -j ";
   switch (code) {
@@ -426,7 +641,69 @@ std::string Emitter::num_to_ip(const dim_t ip_num) {
 
 
 void Emitter::emit_non_applicable_rule(const Rule* rule,
-    const std::string& chain, std::stringstream& out) {
+    const std::string& chain, std::ostream& out) {
+
+  rule->write_with_patched_chain(out, chain);
+  out << std::endl;
+}
+
+
+static void child_packet_weights(const TreeNode* node,
+    std::vector<size_t>& weights) {
+
+  const size_t num_children = node->num_children();
+  weights.resize(num_children);
+  for (size_t i = 0; i < num_children; ++i)
+    weights[i] = node->child(i).packet_weight();
+}
+
+
+size_t BinSearchTree::weighted_median(const size_t start, const size_t end,
+    const std::vector<size_t>& weights) {
 
-  out << rule->src_with_patched_chain(chain) << std::endl;
+  size_t total = 0;
+  for (size_t i = start; i <= end; ++i)
+    total += weights[i];
+  if (total == 0)
+    return ((end - start) >> 1) + start;
+  size_t weight = 0;
+  size_t i = start;
+  for (; i < end; ++i) {
+    weight += weights[i];
+    if (2 * weight >= total)
+      break;
+  }
+  return i == end && end > start ? end - 1 : i;
+}
+
+
+RuleCounter::int_type RuleCounter::overflow(int_type c) {
+  if (traits_type::eq_int_type(c, traits_type::eof()))
+    return traits_type::not_eof(c);
+  static const char prefix[] = "-A ";
+  const char ch = traits_type::to_char_type(c);
+  if (ch == '\n') {
+    column_ = 0;
+  } else if (column_ < 3) {
+    // a mismatch ends the comparison for the rest of the line
+    column_ = ch == prefix[column_] ? column_ + 1 : 4;
+    if (column_ == 3)
+      ++num_rules_;
+  }
+  return c;
+}
+
+
+std::streamsize RuleCounter::xsputn(const char* s, std::streamsize n) {
+  const char* const end = s + n;
+  while (s < end) {
+    // the rest of a line that has been classified does not matter
+    if (column_ >= 3) {
+      s = static_cast<const char*>(memchr(s, '\n', end - s));
+      if (s == nullptr)
+        break;
+    }
+    overflow(traits_type::to_int_type(*s++));
+  }
+  return n;
 }
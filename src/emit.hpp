@@ -3,6 +3,8 @@
 
 #include <cstdlib>
 #include <cstdio>
+#include <streambuf>
+#include <unordered_set>
 #include "treenode.hpp"
 
 class Emitter {
@@ -17,7 +19,7 @@ public:
    * Computes the iptables representation of the given HiTables instance and
    * writes it to the specified out stream.
    */
-  void emit(std::stringstream& out, StrVector& chains,
+  void emit(std::ostream& out, StrVector& chains,
       const DefaultPolicies& policies);
 
   static void emit_prefix(std::ofstream& out, const DefaultPolicies& policies);
@@ -25,23 +27,30 @@ public:
   static void emit_suffix(std::ofstream& out);
 
   void emit_non_applicable_rule(const Rule* rule, const std::string& chain,
-      std::stringstream& out);
+      std::ostream& out);
 
   void emit_tree(TreeNode* tree,
       const std::string& chain, const size_t tree_id,
       const std::string& next_chain, const bool leaf_jump,
-      std::stringstream& out, StrVector& chains);
+      std::ostream& out, StrVector& chains);
 
   void emit_simple_binary_dispatch(TreeNode* node,
       const std::string& chain, const size_t tree_id,
-      const size_t chain_count, std::stringstream& out, StrVector& chains);
+      const size_t chain_count, std::ostream& out, StrVector& chains);
+
+  /*
+   * Emits the rules that have been pushed up to the given inner node, which
+   * are matched before the dispatch to its children.
+   */
+  void emit_pushed_rules(const TreeNode* node,
+      const std::string& current_chain, std::ostream& out);
 
   void emit_leaf(const TreeNode* node, const std::string& current_chain,
       const std::string& next_chain, const bool leaf_jump,
-      std::stringstream& out);
+      std::ostream& out);
 
   void emit_custom_default_rule(const std::string& chain,
-      const ActionCode code, std::stringstream& out);
+      const ActionCode code, std::ostream& out);
 
   static std::string num_to_ip(const dim_t ip_num);
 
@@ -53,6 +62,32 @@ private:
 };
 
 
+/*
+ * Stream buffer that discards what is written to it and counts the lines
+ * that start with "-A ", i.e. the rules the Emitter writes.  Lets the number
+ * of rules of an output be known without keeping the output.
+ */
+class RuleCounter : public std::streambuf {
+public:
+
+  RuleCounter() : num_rules_(0), column_(0) {}
+
+  inline size_t num_rules() const {return num_rules_;}
+
+protected:
+
+  virtual int_type overflow(int_type c);
+
+  virtual std::streamsize xsputn(const char* s, std::streamsize n);
+
+private:
+  size_t num_rules_;
+  // how many characters of "-A " the current line starts with, or 4 if it
+  // starts with something else
+  size_t column_;
+};
+
+
 class BinSearchTree {
 public:
 
@@ -69,6 +104,23 @@ public:
     right_ = new BinSearchTree(lookup_index_ + 1, end);
   }
 
+  /*
+   * Builds a search tree whose lookup indices split the weights of their
+   * ranges in half, so that heavy indices are found after few tests.  Ranges
+   * without weight are split in the middle.
+   */
+  BinSearchTree(const size_t start, const size_t end,
+      const std::vector<size_t>& weights) : start_(start), end_(end),
+      lookup_index_(BinSearchTree::weighted_median(start, end, weights)),
+      left_(nullptr), right_(nullptr) {
+
+    if (end == start)
+      return;
+    if (lookup_index_ > start)
+      left_ = new BinSearchTree(start, lookup_index_ - 1, weights);
+    right_ = new BinSearchTree(lookup_index_ + 1, end, weights);
+  }
+
   ~BinSearchTree() {
     if (has_left_child())
       delete left_;
@@ -94,6 +146,15 @@ public:
 
   inline DomainTuple borders() const {return std::make_tuple(start_, end_);}
 
+  /*
+   * Returns the first index in [start, end) up to which the weights make up
+   * half of the range's weight, or the middle of the range if it weighs
+   * nothing.  The last index is never returned, as the right branch of a
+   * lookup must not be empty.
+   */
+  static size_t weighted_median(const size_t start, const size_t end,
+      const std::vector<size_t>& weights);
+
 private:
   size_t start_;
   size_t end_;
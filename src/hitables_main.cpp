@@ -4,6 +4,7 @@
 #include <chrono>
 #include "treenode.hpp"
 #include "emit.hpp"
+#include "tune.hpp"
 
 const std::string RED("\x1b[31m");
 const std::string YELLOW("\x1b[33m");
@@ -17,13 +18,26 @@ void print_error(const std::string& error) {
 }
 
 
+void print_warning(const std::string& warning) {
+  std::cout << std::endl << YELLOW << "WARNING: " << warning << RESET
+      << std::endl << std::endl;
+}
+
+
 void print_usage(const std::string& path) {
   std::cout << std::endl << YELLOW << "Usage: " << path << std::endl
     << "    [--binth <NUM>]" << std::endl
     << "    [--spfac <NUM>]" << std::endl
     << "    [--search <linear|binary>]" << std::endl
-    << "    [--dim-choice <max-dist|least-max>]" << std::endl
+    << "    [--dim-choice <max-dist|least-max|cost>]" << std::endl
+    << "    [--cut-algo <equidistant|unequal|hypercuts|hypersplit>]"
+    << std::endl
+    << "    [--separate-large]" << std::endl
+    << "    [--compact-regions]" << std::endl
+    << "    [--autotune]" << std::endl
+    << "    [--trace <PATH_TO_TRACE>]" << std::endl
     << "    [--min-rules <NUM>]" << std::endl
+    << "    [--jobs <NUM>]" << std::endl
     << "     --infile <PATH_TO_FILE>"
     << RESET
     << std::endl << std::endl;
@@ -64,15 +78,17 @@ int main(int argc, char* argv[]) {
     return EXIT_FAILURE;
   }
 
-  StrVector input;
-  if (parse::file_read_lines(args.infile(), input) == 1) {
-    std::stringstream ss;
-    ss << "File '" << args.infile() << "' is not accessible!";
-    print_error(ss.str());
+  // the input stays mapped until exit, the parser works on views of it
+  std::unique_ptr<MappedFile> infile;
+  ViewVector input;
+  try {
+    infile.reset(new MappedFile(args.infile()));
+  } catch (const std::string& msg) {
+    print_error(msg);
     return EXIT_FAILURE;
   }
+  infile->lines(input);
 
-  srand(args.random_seed());
   Clock::time_point start, end;
   double time_span;
   std::ofstream out;
@@ -89,7 +105,7 @@ int main(int argc, char* argv[]) {
   ChainVector chains;
   start = Clock::now();
   DefaultPolicies policies;
-  parse::parse_rules(input, rules, policies);
+  parse::parse_rules(input, rules, policies, args.jobs());
   parse::group_rules_by_chain(rules, chains);
   end = Clock::now();
   time_span = duration(start, end);
@@ -107,6 +123,8 @@ int main(int argc, char* argv[]) {
     chain_domains.push_back(DomainVector());
     DomainVector& domains = chain_domains[i];
     parse::compute_relevant_sub_rulesets(chains[i], args.min_rules(), domains);
+    if (args.separate_large())
+      parse::separate_large_field_rules(chains[i], args.min_rules(), domains);
     num_domains += domains.size();
   }
   end = Clock::now();
@@ -114,39 +132,57 @@ int main(int argc, char* argv[]) {
   out << "# Sub-ruleset extraction (" << num_domains << "): " << time_span
       << " seconds" << std::endl;
 
+  // load the packet trace
+  PacketSet packets;
+  if (!args.trace_file().empty()) {
+    start = Clock::now();
+    size_t num_rejected;
+    try {
+      num_rejected = trace::read_trace_file(args.trace_file(), packets);
+    } catch (const std::string& msg) {
+      print_error(msg);
+      return EXIT_FAILURE;
+    }
+    end = Clock::now();
+    if (num_rejected > 0) {
+      std::stringstream ss;
+      ss << "Skipped lines of trace file '" << args.trace_file()
+          << "' that do not hold a packet: " << num_rejected;
+      print_warning(ss.str());
+    }
+    time_span = duration(start, end);
+    out << "# Trace loading (" << packets.total_weight() << "): " << time_span
+        << " seconds" << std::endl;
+  }
+
+  // search the tree parameters
+  Arguments tree_args(args);
+  std::stringstream tune_out;
+  if (args.autotune()) {
+    start = Clock::now();
+    tree_args = tune::autotune(chains, chain_domains, args, packets, policies,
+        tune_out);
+    end = Clock::now();
+    time_span = duration(start, end);
+    out << "# Autotuning (" << tune::num_candidates() << "): " << time_span
+        << " seconds" << std::endl;
+  }
+
   // perform HiCuts transformation
   std::vector<NodeRefVector> chain_trees;
-  const size_t dim_choice = args.dim_choice();
-  const size_t cut_algo = args.cut_algo();
   start = Clock::now();
-  for (size_t i_chain = 0; i_chain < num_chains; ++i_chain) {
-    chain_trees.push_back(NodeRefVector());
-    for (size_t i = 0; i < num_domains; ++i) {
-      const DomainTuple& domain = chain_domains[i_chain][i];
-      TreeNode* tree_root = new TreeNode(chains[i_chain], domain);
-      tree_root->build_tree(args.spfac(), args.binth(), dim_choice, cut_algo);
-      chain_trees[i_chain].push_back(tree_root);
-      ///std::cout << "\n\n===\n";
-      ///std::cout << "FINISHED TREE " << (i + 1) << " OF " << num_domains << std::endl;
-      ///std::cout << "===\n\n";
-    }
-  }
+  tune::build_trees(chains, chain_domains, tree_args, packets, args.jobs(),
+      chain_trees);
   end = Clock::now();
   time_span = duration(start, end);
   out << "# HiCuts transformation: " << time_span << " seconds" << std::endl;
 
   // generate the output
   std::stringstream rule_out;
-  rule_out << std::endl;
   std::vector<StrVector> chain_names;
   start = Clock::now();
-  for (size_t i = 0; i < num_chains; ++i)
-    chain_names.push_back(StrVector());
-  for (size_t i = 0; i < num_chains; ++i) {
-    Emitter emitter(chain_trees[i], chains[i], chain_domains[i],
-        args.search());
-    emitter.emit(rule_out, chain_names[i], policies);
-  }
+  tune::emit_trees(chain_trees, chains, chain_domains, args.search(), policies,
+      rule_out, chain_names);
 
   // emit chain names
   std::stringstream chain_out;
@@ -159,7 +195,7 @@ int main(int argc, char* argv[]) {
   end = Clock::now();
   time_span = duration(start, end);
   out << "# iptables output generation: " << time_span << " seconds"
-      << std::endl << std::endl;
+      << std::endl << tune_out.str() << std::endl;
   Emitter::emit_prefix(out, policies);
   out << chain_out.str() << rule_out.str();
   Emitter::emit_suffix(out);
@@ -168,11 +204,8 @@ int main(int argc, char* argv[]) {
   out.close();
 
   // cleanup
+  tune::delete_trees(chain_trees);
   for (size_t i = 0; i < num_chains; ++i) {
-    std::vector<TreeNode*>& tree_nodes = chain_trees[i];
-    const size_t num_trees = tree_nodes.size();
-    for (size_t j = 0; j < num_trees; ++j)
-      delete tree_nodes[j];
     // delete rules
     RuleVector& chain = chains[i];
     const size_t num_rules_in_chain = chain.size();
@@ -187,8 +220,11 @@ int main(int argc, char* argv[]) {
   parse::file_read_lines(args.outfile(), generated_lines);
   const size_t num_out_lines = generated_lines.size();
   out.open(args.outfile());
+  // the phase timings come first
+  const size_t num_timings = 4 + (args.trace_file().empty() ? 0 : 1)
+      + (args.autotune() ? 1 : 0);
   size_t i = 0;
-  for (; i < 4; ++i)
+  for (; i < num_timings; ++i)
     out << generated_lines[i] << std::endl;
   out << "# Total runtime: " << time_span << " seconds" << std::endl;
   for (; i < num_out_lines; ++i)
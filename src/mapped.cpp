@@ -0,0 +1,61 @@
+#include "mapped.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+const size_t StrView::npos;
+
+
+MappedFile::MappedFile(const std::string& path) : data_(nullptr), size_(0) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    if (fd >= 0)
+      close(fd);
+    throw "File '" + path + "' is not accessible!";
+  }
+  size_ = st.st_size;
+  // mmap rejects empty mappings, an empty file simply has no lines
+  if (size_ > 0) {
+    void* addr = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+      close(fd);
+      throw "File '" + path + "' is not accessible!";
+    }
+    madvise(addr, size_, MADV_SEQUENTIAL);
+    data_ = static_cast<const char*>(addr);
+  }
+  close(fd);
+}
+
+
+MappedFile::~MappedFile() {
+  if (data_ != nullptr)
+    munmap(const_cast<char*>(data_), size_);
+}
+
+
+static inline bool is_ws_char(const char c) {
+  return (c == ' ' || c == '\n' || c == '\t' || c == '\r');
+}
+
+
+void MappedFile::lines(ViewVector& lines) const {
+  const char* pos = data_;
+  const char* const end = data_ + size_;
+  while (pos < end) {
+    const char* eol = static_cast<const char*>(memchr(pos, '\n', end - pos));
+    if (eol == nullptr)
+      eol = end;
+    const char* start = pos;
+    const char* stop = eol;
+    while (start < stop && is_ws_char(*start))
+      ++start;
+    while (stop > start && is_ws_char(stop[-1]))
+      --stop;
+    if (stop > start)
+      lines.push_back(StrView(start, stop - start));
+    pos = eol + 1;
+  }
+}
@@ -0,0 +1,111 @@
+#ifndef HITABLES_MAPPED_HPP
+#define HITABLES_MAPPED_HPP 1
+
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <ostream>
+
+/*
+ * Non-owning view of a character range, such as a line of a mapped file.
+ * The viewed characters must outlive the view.
+ */
+class StrView {
+public:
+  StrView() : data_(nullptr), size_(0) {}
+
+  StrView(const char* data, const size_t size) : data_(data), size_(size) {}
+
+  StrView(const char* str) : data_(str), size_(strlen(str)) {}
+
+  StrView(const std::string& str) : data_(str.data()), size_(str.size()) {}
+
+  // a view of a temporary string would dangle right away
+  StrView(std::string&&) = delete;
+
+  static const size_t npos = SIZE_MAX;
+
+  inline const char* data() const {return data_;}
+
+  inline size_t size() const {return size_;}
+
+  inline bool empty() const {return size_ == 0;}
+
+  inline char operator[](const size_t i) const {return data_[i];}
+
+  inline std::string str() const {return std::string(data_, size_);}
+
+  /*
+   * Returns the view of at most len characters starting at pos.
+   */
+  inline StrView substr(const size_t pos, const size_t len = npos) const {
+    const size_t rest = size_ - pos;
+    return StrView(data_ + pos, len < rest ? len : rest);
+  }
+
+  /*
+   * Returns the position of the first occurrence of c at or after pos, or
+   * npos.
+   */
+  inline size_t find(const char c, const size_t pos = 0) const {
+    for (size_t i = pos; i < size_; ++i)
+      if (data_[i] == c)
+        return i;
+    return npos;
+  }
+
+  inline bool operator==(const StrView& other) const {
+    return size_ == other.size_
+        && (size_ == 0 || memcmp(data_, other.data_, size_) == 0);
+  }
+
+  inline bool operator!=(const StrView& other) const {
+    return !(*this == other);
+  }
+
+private:
+  const char* data_;
+  size_t size_;
+};
+
+typedef std::vector<StrView> ViewVector;
+
+inline std::ostream& operator<<(std::ostream& out, const StrView& view) {
+  return out.write(view.data(), view.size());
+}
+
+
+/*
+ * Read-only memory mapping of a whole file.  Lines handed out by lines() are
+ * views into the mapping and stay valid as long as the MappedFile lives.
+ */
+class MappedFile {
+public:
+  /*
+   * Maps the file at the given path.
+   * Throws an std::string if the file is not accessible.
+   */
+  explicit MappedFile(const std::string& path);
+
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  inline const char* data() const {return data_;}
+
+  inline size_t size() const {return size_;}
+
+  /*
+   * Appends all non-empty lines, without surrounding whitespace, to lines.
+   */
+  void lines(ViewVector& lines) const;
+
+private:
+  const char* data_;
+  size_t size_;
+};
+
+#endif // HITABLES_MAPPED_HPP
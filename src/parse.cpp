@@ -1,4 +1,7 @@
 #include "parse.hpp"
+#include "pool.hpp"
+#include "shadow.hpp"
+#include <memory>
 
 int parse::split(const std::string& str, const std::string& sep,
     StrVector& parts) {
@@ -71,113 +74,142 @@ inline bool is_num(const char c) {
 }
 
 
-uint32_t parse::parse_ip(const std::string& str) {
-  StrVector parts;
-  parse::split(str, ".", parts);
-  const size_t num_parts = parts.size();
-  if (num_parts > 4)
-    throw "Invalid subnet: '" + str + "'";
+/*
+ * Parses an unsigned decimal number of 1 to max_digits digits.
+ * Returns false if str is not such a number.
+ */
+static bool parse_decimal(const StrView& str, const size_t max_digits,
+    uint32_t& value) {
+
+  const size_t len = str.size();
+  if (len == 0 || len > max_digits)
+    return false;
+  value = 0;
+  for (size_t i = 0; i < len; ++i) {
+    if (!is_num(str[i]))
+      return false;
+    value = value * 10 + (str[i] - '0');
+  }
+  return true;
+}
+
+
+bool parse::next_token(const StrView& str, size_t& pos, StrView& token) {
+  const size_t len = str.size();
+  if (pos > len)
+    return false;
+  const size_t sep = str.find(' ', pos);
+  if (sep == StrView::npos) {
+    token = str.substr(pos);
+    pos = len + 1;
+  } else {
+    token = str.substr(pos, sep - pos);
+    pos = sep + 1;
+  }
+  return true;
+}
+
+
+uint32_t parse::parse_ip(const StrView& str) {
   uint32_t ip_val = 0;
   uint32_t shift = 24;
-  for (size_t i = 0; i < num_parts; ++i) {
-    const std::string& octet = parts[i];
-    const size_t octet_len = octet.size();
-    if (octet_len == 0 || octet_len > 3)
-      throw "Invalid subnet: '" + str + "'";
-    for (size_t j = 0; j < octet_len; ++j)
-      if (!is_num(octet[j]))
-        throw "Invalid subnet: '" + str + "'";
-    int octet_val;
-    sscanf(octet.c_str(), "%d", &octet_val);
-    if (octet_val < 0 || octet_val > 255)
-      throw "Invalid subnet: '" + str + "'";
+  size_t num_parts = 0;
+  size_t start = 0;
+  while (true) {
+    const size_t dot = str.find('.', start);
+    const StrView octet(dot == StrView::npos ? str.substr(start)
+        : str.substr(start, dot - start));
+    uint32_t octet_val;
+    if (++num_parts > 4 || !parse_decimal(octet, 3, octet_val)
+        || octet_val > 255)
+      throw "Invalid subnet: '" + str.str() + "'";
     ip_val |= (octet_val << shift);
+    if (dot == StrView::npos)
+      return ip_val;
     shift -= 8;
+    start = dot + 1;
   }
-  return ip_val;
 }
 
 
-uint32_t parse::parse_port(const std::string& port) {
-  const size_t len = port.size();
-  if (len > 5 || len == 0)
-    throw "Invalid port: '" + port + "'";
-  for (size_t i = 0; i < len; ++i)
-    if (!is_num(port[i]))
-      throw "Invalid port: '" + port + "'";
-  int port_num;
-  sscanf(port.c_str(), "%d", &port_num);
-  if (port_num > 65535)
-    throw "Invalid port: '" + port + "'";
-  return static_cast<uint32_t>(port_num);
+uint32_t parse::parse_port(const StrView& port) {
+  uint32_t port_num;
+  if (!parse_decimal(port, 5, port_num) || port_num > 65535)
+    throw "Invalid port: '" + port.str() + "'";
+  return port_num;
+}
+
+
+/*
+ * Splits str at its only occurrence of sep.
+ * Returns false if sep does not occur exactly once.
+ */
+static bool split_pair(const StrView& str, const char sep, StrView& first,
+    StrView& second) {
+
+  const size_t index = str.find(sep);
+  if (index == StrView::npos || str.find(sep, index + 1) != StrView::npos)
+    return false;
+  first = str.substr(0, index);
+  second = str.substr(index + 1);
+  return true;
 }
 
 
-DimTuple parse::parse_port_range(const std::string& str) {
-  StrVector parts;
-  parse::split(str, ":", parts);
-  if (parts.size() != 2)
-    throw "Invalid port range: '" + str + "'";
-  const uint32_t port1 = parse::parse_port(parts[0]);
-  const uint32_t port2 = parse::parse_port(parts[1]);
+DimTuple parse::parse_port_range(const StrView& str) {
+  StrView first, second;
+  if (!split_pair(str, ':', first, second))
+    throw "Invalid port range: '" + str.str() + "'";
+  const uint32_t port1 = parse::parse_port(first);
+  const uint32_t port2 = parse::parse_port(second);
   return std::make_tuple(port1, port2);
 }
 
 
-DimTuple parse::parse_subnet(const std::string& str) {
-  StrVector parts;
-  parse::split(str, "/", parts);
-  const size_t num_parts = parts.size();
-  if (num_parts == 1) {
-    const dim_t ip_val = parse::parse_ip(parts[0]);
+DimTuple parse::parse_subnet(const StrView& str) {
+  if (str.find('/') == StrView::npos) {
+    const dim_t ip_val = parse::parse_ip(str);
     return std::make_tuple(ip_val, ip_val);
-  } else if (num_parts > 2)
-    throw "Invalid subnet: '" + str + "'";
+  }
+  StrView ip_str, mask_str;
+  if (!split_pair(str, '/', ip_str, mask_str))
+    throw "Invalid subnet: '" + str.str() + "'";
   // we have a real subnet
-  const dim_t ip_val = parse::parse_ip(parts[0]);
+  const dim_t ip_val = parse::parse_ip(ip_str);
   // check mask
-  const std::string& mask_str = parts[1];
-  const size_t mask_len = mask_str.size();
-  if (mask_len == 0 || mask_len > 2)
-    throw "Invalid subnet: '" + str + "'";
-  for (size_t i = 0; i < mask_len; ++i)
-    if (!is_num(mask_str[i]))
-      throw "Invalid subnet: '" + str + "'";
-  int mask_val;
-  sscanf(mask_str.c_str(), "%d", &mask_val);
-  if (mask_val > 32)
-    throw "Invalid subnet: '" + str + "'";
+  uint32_t mask_val;
+  if (!parse_decimal(mask_str, 2, mask_val) || mask_val > 32)
+    throw "Invalid subnet: '" + str.str() + "'";
   // compute min and max ip of subnet
   if (mask_val == 0)
     return std::make_tuple(min_ip, max_ip);
   const dim_t host_len = 32 - mask_val;
   const dim_t min_ip = (ip_val >> host_len) << host_len;
-  const dim_t max_ip = min_ip + ((1 << host_len) - 1);
+  const dim_t max_ip = min_ip + ((1U << host_len) - 1);
   return std::make_tuple(min_ip, max_ip);
 }
 
 
-DimTuple parse::parse_ip_range(const std::string& str) {
-  StrVector parts;
-  parse::split(str, "-", parts);
-  if (parts.size() != 2)
-    throw "Invalid IP range: '" + str + "'";
-  const dim_t start_ip(parse::parse_ip(parts[0])); 
-  const dim_t end_ip(parse::parse_ip(parts[1]));
+DimTuple parse::parse_ip_range(const StrView& str) {
+  StrView first, second;
+  if (!split_pair(str, '-', first, second))
+    throw "Invalid IP range: '" + str.str() + "'";
+  const dim_t start_ip(parse::parse_ip(first));
+  const dim_t end_ip(parse::parse_ip(second));
   return std::make_tuple(start_ip, end_ip);
 }
 
 
-dim_t parse::parse_protocol(const std::string& str) {
+dim_t parse::parse_protocol(const StrView& str) {
   if (str == "tcp")
     return TCP;
   if (str == "udp")
     return UDP;
-  throw "Invalid protocol: '" + str + "'";
+  throw "Invalid protocol: '" + str.str() + "'";
 }
 
 
-ActionCode parse::parse_action_code(const std::string& str) {
+ActionCode parse::parse_action_code(const StrView& str) {
   if (str == "ACCEPT")
     return ACCEPT;
   if (str == "DROP")
@@ -188,17 +220,70 @@ ActionCode parse::parse_action_code(const std::string& str) {
 }
 
 
-inline void check_index(const size_t i, const size_t len,
-    const std::string& msg) {
-  if (i >= len)
-    throw msg;
+enum OptionKeyword {OPT_CHAIN, OPT_PROTOCOL, OPT_MATCH, OPT_SRC, OPT_DST,
+    OPT_SRC_RANGE, OPT_DST_RANGE, OPT_SPORT, OPT_DPORT, OPT_JUMP, OPT_UNKNOWN};
+
+static const char* const option_errors[] = {
+  "Invalid chain specification",
+  "Invalid protocol specification",
+  "Invalid match specification",
+  "Invalid --src or --dst specification",
+  "Invalid --src or --dst specification",
+  "Invalid --src-range or --dst-range specification",
+  "Invalid --src-range or --dst-range specification",
+  "Invalid --sport or --dport specification",
+  "Invalid --sport or --dport specification",
+  "Invalid jump (-j) specification"
+};
+
+
+/*
+ * Identifies an iptables option by its length and the characters that tell
+ * the options of that length apart, then confirms the whole word.
+ */
+static OptionKeyword option_keyword(const StrView& word) {
+  switch (word.size()) {
+    case 2:
+      if (word[0] != '-')
+        return OPT_UNKNOWN;
+      switch (word[1]) {
+        case 'A': return OPT_CHAIN;
+        case 'p': return OPT_PROTOCOL;
+        case 'm': return OPT_MATCH;
+        case 'j': return OPT_JUMP;
+        default: return OPT_UNKNOWN;
+      }
+    case 5:
+      if (word == "--src")
+        return OPT_SRC;
+      return word == "--dst" ? OPT_DST : OPT_UNKNOWN;
+    case 7:
+      if (word == "--sport")
+        return OPT_SPORT;
+      return word == "--dport" ? OPT_DPORT : OPT_UNKNOWN;
+    case 11:
+      if (word == "--src-range")
+        return OPT_SRC_RANGE;
+      return word == "--dst-range" ? OPT_DST_RANGE : OPT_UNKNOWN;
+    default:
+      return OPT_UNKNOWN;
+  }
 }
 
 
-Rule* parse::parse_rule(const std::string& input) {
-  StrVector parts;
-  parse::split(input, " ", parts);
-  const size_t len = parts.size();
+/*
+ * Records where the chain name, if any, lies within the rule's source text.
+ */
+static Rule* with_chain_span(Rule* rule, const StrView& input,
+    const StrView& chain) {
+
+  if (chain.data() != nullptr)
+    rule->set_chain_span(chain.data() - input.data(), chain.size());
+  return rule;
+}
+
+
+Rule* parse::parse_rule(const StrView& input) {
   dim_t min_sport = min_port;
   dim_t max_sport = max_port;
   dim_t min_dport = min_port;
@@ -209,96 +294,93 @@ Rule* parse::parse_rule(const std::string& input) {
   dim_t max_daddr = max_ip;
   dim_t prot = PROTOCOL_WILDCARD;
   Action action(NONE);
-  std::string chain("");
+  StrView chain;
   bool applicable = true;
 
-  for (size_t i = 0; i < len; ++i) {
-    const std::string& word = parts[i];
-    if (word == "-A") {
-      ++i;
-      check_index(i, len, "Invalid chain specification");
-      chain = parts[i];
-
-    } else if (word == "-p") {
-      ++i;
-      check_index(i, len, "Invalid protocol specification");
-      try {
-        prot = parse::parse_protocol(parts[i]);
-      } catch (const std::string& msg) {
-        //return new Rule(input);
-        applicable = false;
+  size_t pos = 0;
+  StrView word, value;
+  while (parse::next_token(input, pos, word)) {
+    const OptionKeyword keyword = option_keyword(word);
+    if (keyword == OPT_UNKNOWN)
+      return with_chain_span(new Rule(input), input, chain);
+    if (!parse::next_token(input, pos, value))
+      throw std::string(option_errors[keyword]);
+
+    switch (keyword) {
+      case OPT_CHAIN:
+        chain = value;
+        break;
+
+      case OPT_PROTOCOL:
+        try {
+          prot = parse::parse_protocol(value);
+        } catch (const std::string& msg) {
+          applicable = false;
+        }
+        break;
+
+      case OPT_MATCH:
+        if (value != "iprange" && value != "tcp" && value != "udp")
+          applicable = false;
+        break;
+
+      case OPT_SRC:
+      case OPT_DST: {
+        const bool is_src = keyword == OPT_SRC;
+        dim_t* min = is_src ? &min_saddr : &min_daddr;
+        dim_t* max = is_src ? &max_saddr : &max_daddr;
+        const DimTuple net_tuple(parse::parse_subnet(value));
+        *min = std::get<0>(net_tuple);
+        *max = std::get<1>(net_tuple);
+        break;
       }
 
-    } else if (word == "-m") {
-      ++i;
-      check_index(i, len, "Invalid match specification");
-      if (parts[i] != "iprange" && parts[i] != "tcp" && parts[i] != "udp")
-        //return new Rule(input);
-        applicable = false;
-
-    } else if (word == "--src" || word == "--dst") {
-      ++i;
-      check_index(i, len, "Invalid --src or --dst specification");
-      const bool is_src = word[2] == 's';
-      dim_t* min = is_src ? &min_saddr : &min_daddr;
-      dim_t* max = is_src ? &max_saddr : &max_daddr;
-      const DimTuple net_tuple(parse::parse_subnet(parts[i]));
-      *min = std::get<0>(net_tuple);
-      *max = std::get<1>(net_tuple);
-
-    } else if (word == "--src-range" || word == "--dst-range") {
-      ++i;
-      check_index(i, len, "Invalid --src-range or --dst-range specification");
-      const bool is_src = word[2] == 's';
-      dim_t* min = is_src ? &min_saddr : &min_daddr;
-      dim_t* max = is_src ? &max_saddr : &max_daddr;
-      const DimTuple src_tuple(parse::parse_ip_range(parts[i]));
-      *min = std::get<0>(src_tuple);
-      *max = std::get<1>(src_tuple);
-
-    } else if (word == "--sport" || word == "--dport") {
-      ++i;
-      check_index(i, len, "Invalid --sport or --dport specification");
-      const bool is_sport = word[2] == 's';
-      dim_t* min = is_sport ? &min_sport : &min_dport;
-      dim_t* max = is_sport ? &max_sport : &max_dport;
-      if (parts[i].find(":") != std::string::npos) {
-        const DimTuple ports(parse::parse_port_range(parts[i]));
-        *min = std::get<0>(ports);
-        *max = std::get<1>(ports);
-      } else {
-        const dim_t port(parse::parse_port(parts[i]));
-        *min = *max = port;
+      case OPT_SRC_RANGE:
+      case OPT_DST_RANGE: {
+        const bool is_src = keyword == OPT_SRC_RANGE;
+        dim_t* min = is_src ? &min_saddr : &min_daddr;
+        dim_t* max = is_src ? &max_saddr : &max_daddr;
+        const DimTuple range_tuple(parse::parse_ip_range(value));
+        *min = std::get<0>(range_tuple);
+        *max = std::get<1>(range_tuple);
+        break;
       }
 
-    } else if (word == "-j") {
-      ++i;
-      check_index(i, len, "Invalid jump (-j) specification");
-      ActionCode code(NONE);
-      try {
-        code = parse::parse_action_code(parts[i]);
-      } catch (const int err_code) {
-        //return new Rule(input);
-        applicable = false;
+      case OPT_SPORT:
+      case OPT_DPORT: {
+        const bool is_sport = keyword == OPT_SPORT;
+        dim_t* min = is_sport ? &min_sport : &min_dport;
+        dim_t* max = is_sport ? &max_sport : &max_dport;
+        if (value.find(':') != StrView::npos) {
+          const DimTuple ports(parse::parse_port_range(value));
+          *min = std::get<0>(ports);
+          *max = std::get<1>(ports);
+        } else
+          *min = *max = parse::parse_port(value);
+        break;
       }
-      if (code == JUMP) {
-        //++i;
-        //check_index(i, len, "Invalid jump (-j) specification");
-        action = Action(code, parts[i]);
-      } else
-        action = Action(code);
-
-    } else
-      return new Rule(input);
+
+      case OPT_JUMP: {
+        const ActionCode code = parse::parse_action_code(value);
+        if (code == JUMP)
+          action = Action(code, value.str());
+        else
+          action = Action(code);
+        break;
+      }
+
+      default:
+        break;
+    }
   }
   // XXX should throw an exception here
-  if (chain.size() == 0)
-    return new Rule(input, chain);
+  if (chain.empty())
+    return with_chain_span(new Rule(input, ""), input, chain);
   if (!applicable)
-    return new Rule(input, chain);
+    return with_chain_span(new Rule(input, chain.str()), input, chain);
   // check if a transport layer protocol is specified
   if (prot == PROTOCOL_WILDCARD)
-    return new Rule(input, chain);
+    return with_chain_span(new Rule(input, chain.str()), input, chain);
 
   // assemble rule from data gathered above
   DimVector dims;
@@ -306,11 +388,24 @@ Rule* parse::parse_rule(const std::string& input) {
   dims.push_back(std::make_tuple(min_dport, max_dport));
   dims.push_back(std::make_tuple(min_saddr, max_saddr));
   dims.push_back(std::make_tuple(min_daddr, max_daddr));
-  return new Rule(action, dims, chain, input, prot);
+  return with_chain_span(new Rule(action, dims, chain.str(), input, prot),
+      input, chain);
+}
+
+
+Rule* parse::parse_rule(const std::string& input) {
+  Rule* rule = parse::parse_rule(StrView(input));
+  rule->copy_src();
+  return rule;
 }
 
 
-ActionCode parse_policy_code(const std::string& word) {
+Rule* parse::parse_rule(const char* input) {
+  return parse::parse_rule(StrView(input));
+}
+
+
+ActionCode parse_policy_code(const StrView& word) {
   if (word == "ACCEPT")
     return ACCEPT;
   if (word == "DROP")
@@ -323,15 +418,16 @@ ActionCode parse_policy_code(const std::string& word) {
 }
 
 
-void parse::parse_policy(const std::string& line, DefaultPolicies& policies) {
-  StrVector parts;
-  parse::split(line, " ", parts);
-  std::string& policy = parts[1];
-  if (parts[0] == ":INPUT")
+void parse::parse_policy(const StrView& line, DefaultPolicies& policies) {
+  size_t pos = 0;
+  StrView chain, policy;
+  parse::next_token(line, pos, chain);
+  parse::next_token(line, pos, policy);
+  if (chain == ":INPUT")
     policies.set_input_policy(parse_policy_code(policy));
-  else if (parts[0] == ":FORWARD")
+  else if (chain == ":FORWARD")
     policies.set_forward_policy(parse_policy_code(policy));
-  else if (parts[0] == ":OUTPUT")
+  else if (chain == ":OUTPUT")
     policies.set_output_policy(parse_policy_code(policy));
 }
 
@@ -339,16 +435,75 @@ void parse::parse_policy(const std::string& line, DefaultPolicies& policies) {
 void parse::parse_rules(const StrVector& input, RuleVector& rules,
     DefaultPolicies& policies) {
 
-  const size_t num_rules = input.size();
-  for (size_t i = 0; i < num_rules; ++i) {
-    const std::string& line = input[i];
+  const ViewVector views(input.begin(), input.end());
+  parse::parse_rules(views, rules, policies);
+}
+
+
+/*
+ * Parses the rules in the lines [start, end) of input.  Policy lines are
+ * checked, but only collected, since they have to be applied in the order of
+ * the whole input.  The first faulty line ends the chunk, so that rules and
+ * policy lines hold what comes before it.
+ */
+static void parse_chunk(const ViewVector& input, const size_t start,
+    const size_t end, RuleVector& rules, ViewVector& policy_lines) {
+
+  for (size_t i = start; i < end; ++i) {
+    const StrView& line = input[i];
     if (line[0] == '#' || line[0] == '*' || line == "COMMIT")
       continue;
     if (line[0] == ':') {
-      parse::parse_policy(line, policies);
+      DefaultPolicies checked;
+      parse::parse_policy(line, checked);
+      policy_lines.push_back(line);
       continue;
     }
-    rules.push_back(parse::parse_rule(input[i]));
+    rules.push_back(parse::parse_rule(line));
+  }
+}
+
+
+void parse::parse_rules(const ViewVector& input, RuleVector& rules,
+    DefaultPolicies& policies, const size_t jobs) {
+
+  const size_t num_lines = input.size();
+  // several chunks per worker even out chunks of differently expensive lines
+  size_t num_chunks = jobs <= 1 ? 1 : jobs * 4;
+  if (num_chunks > num_lines)
+    num_chunks = num_lines == 0 ? 1 : num_lines;
+  std::vector<RuleVector> chunk_rules(num_chunks);
+  std::vector<ViewVector> chunk_policies(num_chunks);
+  std::vector<std::string> chunk_errors(num_chunks);
+  const WorkerPool pool(jobs);
+  pool.run(num_chunks, [&] (const size_t chunk) {
+    const size_t start = num_lines * chunk / num_chunks;
+    const size_t end = num_lines * (chunk + 1) / num_chunks;
+    try {
+      parse_chunk(input, start, end, chunk_rules[chunk],
+          chunk_policies[chunk]);
+    } catch (const std::string& msg) {
+      chunk_errors[chunk] = msg;
+    }
+  });
+
+  // merge in input order; the first error ends the input as it would have
+  // on a single thread
+  size_t total = rules.size();
+  for (size_t chunk = 0; chunk < num_chunks; ++chunk)
+    total += chunk_rules[chunk].size();
+  rules.reserve(total);
+  for (size_t chunk = 0; chunk < num_chunks; ++chunk) {
+    rules.insert(rules.end(), chunk_rules[chunk].begin(),
+        chunk_rules[chunk].end());
+    const ViewVector& policy_lines = chunk_policies[chunk];
+    for (size_t i = 0; i < policy_lines.size(); ++i)
+      parse::parse_policy(policy_lines[i], policies);
+    if (!chunk_errors[chunk].empty()) {
+      for (size_t later = chunk + 1; later < num_chunks; ++later)
+        Rule::delete_rules(chunk_rules[later]);
+      throw chunk_errors[chunk];
+    }
   }
 }
 
@@ -360,7 +515,7 @@ void parse::compute_relevant_sub_rulesets(RuleVector& rules,
   DomainVector temp_domains;
   // first look for domains where TCP or UDP are specified
   bool have_start = false;
-  size_t start;
+  size_t start = 0;
   for (size_t i = 0; i < len; ++i) {
     const Rule* rule = rules[i];
     const bool applicable = rule->applicable();
@@ -412,6 +567,100 @@ void parse::compute_relevant_sub_rulesets(RuleVector& rules,
 }
 
 
+uint32_t parse::large_fields(const Rule* rule) {
+  static const dim_t dim_max[] = {max_port, max_port, max_ip, max_ip};
+  const DimVector& bounds = rule->box().box_bounds();
+  uint32_t mask = 0;
+  for (size_t dim = 0; dim < bounds.size(); ++dim) {
+    const dim_t width = std::get<1>(bounds[dim]) - std::get<0>(bounds[dim]);
+    if (width >= dim_max[dim] >> 8)
+      mask |= 1U << dim;
+  }
+  return mask;
+}
+
+
+void parse::separate_large_field_rules(RuleVector& rules,
+    const size_t min_rules, DomainVector& domains) {
+
+  // categories with fewer large fields come first
+  static const size_t num_categories = 16;
+  size_t rank[num_categories];
+  std::vector<uint32_t> masks;
+  for (uint32_t mask = 0; mask < num_categories; ++mask)
+    masks.push_back(mask);
+  std::stable_sort(masks.begin(), masks.end(), [] (uint32_t a, uint32_t b) {
+    return __builtin_popcount(a) < __builtin_popcount(b);
+  });
+  for (size_t i = 0; i < num_categories; ++i)
+    rank[masks[i]] = i;
+
+  // swapping two rules may only change the first matching rule of a packet
+  // if they overlap and decide differently
+  const TableBox frame((Box(DimVector())));
+  DomainVector separated;
+  std::vector<std::vector<size_t>> members(num_categories);
+  for (size_t d = 0; d < domains.size(); ++d) {
+    const size_t start = std::get<0>(domains[d]);
+    const size_t end = std::get<1>(domains[d]);
+    // the earlier members of every category are indexed by their action
+    RuleTable table;
+    std::vector<std::vector<Action>> actions(num_categories);
+    std::vector<std::vector<std::unique_ptr<ShadowIndex>>> indexes(
+        num_categories);
+    for (size_t c = 0; c < num_categories; ++c)
+      members[c].clear();
+    // a rule joins the latest category that holds an earlier conflicting rule
+    for (size_t i = start; i <= end; ++i) {
+      const uint32_t id = table.add(rules[i]);
+      const Action& action = rules[i]->action();
+      size_t category = rank[large_fields(rules[i])];
+      for (size_t c = num_categories - 1; c > category; --c) {
+        bool conflict = false;
+        for (size_t a = 0; a < actions[c].size() && !conflict; ++a)
+          conflict = actions[c][a] != action && indexes[c][a]->collides(id);
+        if (conflict) {
+          category = c;
+          break;
+        }
+      }
+      members[category].push_back(i);
+      std::vector<Action>& category_actions = actions[category];
+      size_t a = 0;
+      while (a < category_actions.size() && category_actions[a] != action)
+        ++a;
+      if (a == category_actions.size()) {
+        category_actions.push_back(action);
+        indexes[category].emplace_back(new ShadowIndex(table, frame));
+      }
+      indexes[category][a]->insert(id);
+    }
+    // reorder the rules by category and merge small categories
+    RuleVector reordered;
+    size_t sub_start = start;
+    for (size_t c = 0; c < num_categories; ++c) {
+      for (size_t k = 0; k < members[c].size(); ++k)
+        reordered.push_back(rules[members[c][k]]);
+      const size_t sub_end = start + reordered.size();
+      if (sub_end - sub_start >= min_rules && sub_end <= end) {
+        separated.push_back(std::make_tuple(sub_start, sub_end - 1));
+        sub_start = sub_end;
+      }
+    }
+    std::copy(reordered.begin(), reordered.end(), rules.begin() + start);
+    if (sub_start <= end) {
+      if (sub_start > start && end + 1 - sub_start < min_rules)
+        // the remaining rules are too few for a tree of their own
+        sub_start = std::get<0>(separated.back());
+      else
+        separated.push_back(DomainTuple());
+      separated.back() = std::make_tuple(sub_start, end);
+    }
+  }
+  domains.swap(separated);
+}
+
+
 void parse::group_rules_by_chain(const RuleVector& rules,
     ChainVector& chains) {
 
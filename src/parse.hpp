@@ -7,6 +7,7 @@
 #include <fstream>
 #include <cstdint>
 #include "rule.hpp"
+#include "mapped.hpp"
 #include <unordered_map>
 #include <algorithm>
 
@@ -25,73 +26,105 @@ namespace parse {
    */
   int file_read_lines(const std::string& path, StrVector& lines);
 
+  /*
+   * Reads the token of str that starts at pos and ends before the next space,
+   * and moves pos behind that space.  As with split, consecutive spaces
+   * delimit empty tokens.  The token is a view into str.
+   * Returns false if there is no token left.
+   */
+  bool next_token(const StrView& str, size_t& pos, StrView& token);
+
   /*
    * Parses an IPv4 address in dotted decimal notation.
    * Returns the numeric representation of the IPv4 address.
    * Throws 1 in case of failure.
    */
-  uint32_t parse_ip(const std::string& str);
+  uint32_t parse_ip(const StrView& str);
 
   /*
    * Parses a port number.
    * Returns the numeric representation of the port number.
    * Throws 1 in case of failure.
    */
-  uint32_t parse_port(const std::string& str);
+  uint32_t parse_port(const StrView& str);
 
   /*
    * Parses a port range of the form <START>:<END>.
    * Returns a DimTuple in case of success.
    * Throws 1 in case of failure.
    */
-  DimTuple parse_port_range(const std::string& str);
+  DimTuple parse_port_range(const StrView& str);
 
   /*
    * Parses a subnet string of the form <IP_ADDR>/<NUM_MASK_BITS>.
    * Returns a tuple of the minimum and maximum IP addresses in case of success.
    * Throws 1 in case of failure.
    */
-  DimTuple parse_subnet(const std::string& str);
+  DimTuple parse_subnet(const StrView& str);
   
   /*
    * Parses an IP range of the form <IP>-<IP>.
    * Returns a DimTuple in case of success.
    * Throws 1 in case of failure.
    */
-  DimTuple parse_ip_range(const std::string& str);
+  DimTuple parse_ip_range(const StrView& str);
 
   /*
    * Parses a protocol string.
    * Returns an identifier for the protocol in case of sucess.
    * Throws 1 in case of failure.
    */
-  dim_t parse_protocol(const std::string& str);
+  dim_t parse_protocol(const StrView& str);
 
 
   /*
    * Parses an action string such as ACCEPT, DROP, REJECT, JUMP.
    * Throws 1 in case of failure.
    */
-  ActionCode parse_action_code(const std::string& str);
+  ActionCode parse_action_code(const StrView& str);
 
   /*
    * Checks whether the iptables-save rule is applicable to HiTables usage.
    * Returns a rule object that states whether it is valid or not.
-   * Expects the rule to be whitespace-split.
+   * The rule is tokenized in place, without copying its words, and refers to
+   * input as its source text, so input has to outlive the rule.
+   */
+  Rule* parse_rule(const StrView& input);
+
+  /*
+   * Like the above, but the rule keeps a copy of input, which may therefore
+   * be a temporary.
    */
   Rule* parse_rule(const std::string& input);
 
+  /*
+   * Like the above, for string literals, which outlive every rule and are
+   * not copied.
+   */
+  Rule* parse_rule(const char* input);
+
   /*
    * Parses the given input string into a vector of rule objects.
    * Also determines the specified default policies.
+   * The rules refer to the lines of input, which have to outlive them.
    */
   void parse_rules(const StrVector& input, RuleVector& rules,
       DefaultPolicies& policies);
 
+  /*
+   * Like parse_rules above, but parses lines that are views into the input,
+   * e.g. the lines of a MappedFile.
+   * The lines are split into chunks that are parsed on jobs worker threads.
+   * The rules keep the input order, and the policies are applied in input
+   * order as well.
+   */
+  void parse_rules(const ViewVector& input, RuleVector& rules,
+      DefaultPolicies& policies, const size_t jobs = 1);
+
   /*
    * Determines whether the given line specifies a policy for a builtin chain.
    */
-  void parse_policy(const std::string& line, DefaultPolicies& policies);
+  void parse_policy(const StrView& line, DefaultPolicies& policies);
 
   /*
    * Groups the given rules according to their chains.
@@ -105,6 +138,26 @@ namespace parse {
    */
   void compute_relevant_sub_rulesets(RuleVector& rules, const size_t min_rules,
       DomainVector& domains);
+
+  /*
+   * Returns a bit mask of the dimensions in which the given rule is large,
+   * i.e., spans at least 1/256 of the dimension, such as wildcard ports or
+   * /8 networks.
+   */
+  uint32_t large_fields(const Rule* rule);
+
+  /*
+   * Separates the rules of each domain into categories by their large fields,
+   * as in EffiCuts, so that one tree is built per category.  The rules of a
+   * domain are stably reordered by category, rules with fewer large fields
+   * first, and the domain is split accordingly.  Categories with fewer than
+   * min_rules rules are merged with their neighbour.
+   * A rule is only moved behind a rule of a later category if they do not
+   * overlap or share their action; otherwise it joins that category, so the
+   * first matching rule of every packet stays the same.
+   */
+  void separate_large_field_rules(RuleVector& rules, const size_t min_rules,
+      DomainVector& domains);
 }
 
 #endif // HITABLES_PARSE_HPP
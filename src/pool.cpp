@@ -0,0 +1,49 @@
+#include "pool.hpp"
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+void WorkerPool::run(const size_t num_tasks,
+    const std::function<void(const size_t)>& task) const {
+
+  if (num_tasks == 0)
+    return;
+  if (num_workers_ == 1 || num_tasks == 1) {
+    for (size_t i = 0; i < num_tasks; ++i)
+      task(i);
+    return;
+  }
+
+  std::atomic<size_t> next_task(0);
+  std::atomic<bool> failed(false);
+  std::exception_ptr error;
+  std::mutex error_mutex;
+  auto worker = [&] () {
+    for (;;) {
+      const size_t i = next_task.fetch_add(1);
+      if (i >= num_tasks || failed.load())
+        return;
+      try {
+        task(i);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(error_mutex);
+        if (!failed.exchange(true))
+          error = std::current_exception();
+      }
+    }
+  };
+
+  const size_t num_threads = num_workers_ < num_tasks ? num_workers_
+                                                      : num_tasks;
+  std::vector<std::thread> threads;
+  // the calling thread acts as the last worker
+  for (size_t i = 1; i < num_threads; ++i)
+    threads.push_back(std::thread(worker));
+  worker();
+  for (size_t i = 0; i < threads.size(); ++i)
+    threads[i].join();
+  if (error)
+    std::rethrow_exception(error);
+}
@@ -0,0 +1,75 @@
+#ifndef HITABLES_POOL_HPP
+#define HITABLES_POOL_HPP 1
+
+#include <cstdlib>
+#include <functional>
+#include <deque>
+#include <mutex>
+
+class WorkerPool {
+public:
+  WorkerPool(const size_t num_workers)
+      : num_workers_(num_workers == 0 ? 1 : num_workers) {}
+
+  /*
+   * Runs task(i) for every i in [0, num_tasks) and blocks until all tasks
+   * have finished.  Tasks are handed out in ascending order of i to at most
+   * num_workers threads.  With a single worker, all tasks run on the calling
+   * thread.
+   * If a task throws, the remaining tasks are skipped and the first exception
+   * is rethrown on the calling thread.
+   */
+  void run(const size_t num_tasks,
+      const std::function<void(const size_t)>& task) const;
+
+  inline size_t num_workers() const {return num_workers_;}
+
+private:
+  size_t num_workers_;
+};
+
+
+/*
+ * Double-ended work queue for work-stealing schedulers.  The owning worker
+ * pushes and pops at the back (depth-first, cache-friendly), while idle
+ * workers steal from the front, where the oldest and usually largest pieces
+ * of work wait.
+ */
+template <typename T>
+class StealingDeque {
+public:
+  inline void push(const T& item) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    items_.push_back(item);
+  }
+
+  /*
+   * Takes the most recently pushed item.  Returns false if the deque is empty.
+   */
+  inline bool pop(T& item) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (items_.empty())
+      return false;
+    item = items_.back();
+    items_.pop_back();
+    return true;
+  }
+
+  /*
+   * Takes the oldest item.  Returns false if the deque is empty.
+   */
+  inline bool steal(T& item) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (items_.empty())
+      return false;
+    item = items_.front();
+    items_.pop_front();
+    return true;
+  }
+
+private:
+  std::deque<T> items_;
+  std::mutex mutex_;
+};
+
+#endif // HITABLES_POOL_HPP
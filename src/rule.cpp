@@ -12,30 +12,39 @@ size_t Rule::num_distinct_rules_in_dim(const size_t dim,
     return std::get<0>(a->box().box_bounds()[dim]) <
            std::get<0>(b->box().box_bounds()[dim]);
   });
+  std::vector<DimTuple> intervals;
+  intervals_in_dim(dim, rules, intervals);
+  return num_distinct_sorted_intervals(intervals);
+}
+
+
+size_t Rule::num_distinct_sorted_intervals(
+    const std::vector<DimTuple>& intervals) {
+
+  const size_t num_rules = intervals.size();
+  if (num_rules <= 1)
+    return num_rules;
 
   // consider rules pairwise
   size_t num_distinct = 0;
   const size_t loop_end = num_rules - 1;
   // check first rule
-  const dim_t current_end = std::get<1>(rules[0]->box().box_bounds()[dim]);
-  const dim_t next_start = std::get<0>(rules[1]->box().box_bounds()[dim]);
+  const dim_t current_end = std::get<1>(intervals[0]);
+  const dim_t next_start = std::get<0>(intervals[1]);
   if (current_end < next_start)
     ++num_distinct;
   // check rules 1 to n - 2
   dim_t highest_end = current_end;
   for (size_t i = 1; i < loop_end; ++i) {
-    const Box& box = rules[i]->box();
-    const dim_t current_start = std::get<0>(box.box_bounds()[dim]);
-    const dim_t current_end = std::get<1>(box.box_bounds()[dim]);
-    const dim_t next_start = std::get<0>(
-        rules[i + 1]->box().box_bounds()[dim]);
+    const dim_t current_start = std::get<0>(intervals[i]);
+    const dim_t current_end = std::get<1>(intervals[i]);
+    const dim_t next_start = std::get<0>(intervals[i + 1]);
     if (current_start > highest_end && current_end < next_start)
       ++num_distinct;
     highest_end = highest_end < current_end ? current_end : highest_end;
   }
   // check last rule
-  const dim_t current_start = std::get<0>(
-      rules[loop_end]->box().box_bounds()[dim]);
+  const dim_t current_start = std::get<0>(intervals[loop_end]);
   if (current_start > highest_end)
     ++num_distinct;
   return num_distinct;
@@ -53,21 +62,44 @@ void Rule::cut_points(const size_t dim, std::vector<const Rule*>& rules,
     return std::get<0>(a->box().box_bounds()[dim]) <
            std::get<0>(b->box().box_bounds()[dim]);
   });
+  std::vector<DimTuple> intervals;
+  intervals_in_dim(dim, rules, intervals);
+  sorted_interval_cut_points(intervals, cut_points);
+}
+
+
+void Rule::sorted_interval_cut_points(const std::vector<DimTuple>& intervals,
+    std::vector<dim_t>& cut_points) {
+
+  const size_t num_rules = intervals.size();
+  if (num_rules <= 1)
+    return;
   const size_t until = num_rules - 1;
   dim_t next_start;
   dim_t this_end;
-  dim_t max_end = std::get<1>(rules[0]->box().box_bounds()[dim]);
+  dim_t max_end = std::get<1>(intervals[0]);
   for (size_t i = 0; i < until; ++i) {
-    this_end = std::get<1>(rules[i]->box().box_bounds()[dim]);
+    this_end = std::get<1>(intervals[i]);
     if (this_end > max_end)
       max_end = this_end;
-    next_start = std::get<0>(rules[i + 1]->box().box_bounds()[dim]);
+    next_start = std::get<0>(intervals[i + 1]);
     if (max_end < next_start)
       cut_points.push_back(max_end);
   }
 }
 
 
+void Rule::intervals_in_dim(const size_t dim,
+    const std::vector<const Rule*>& rules, std::vector<DimTuple>& intervals) {
+
+  const size_t num_rules = rules.size();
+  intervals.clear();
+  intervals.reserve(num_rules);
+  for (size_t i = 0; i < num_rules; ++i)
+    intervals.push_back(rules[i]->box().box_bounds()[dim]);
+}
+
+
 bool Rule::operator==(const Rule& other) const {
   return ((box_ == other.box())
       &&  (action_ == other.action())
@@ -75,14 +107,23 @@ bool Rule::operator==(const Rule& other) const {
       &&  (chain_ == other.chain()));
 }
 
-std::string Rule::src_with_patched_chain(const std::string& chain) const {
-  const size_t start = src_.find(chain_);
-  const size_t end = src_.find(" ", start + 2);
-  std::stringstream ss;
-  ss << src_.substr(0, start);
-  ss << chain << " ";
-  ss << src_.substr(end + 1);
-  return ss.str();
+void Rule::copy_src() {
+  owned_src_.reset(new std::string(src_.data(), src_.size()));
+  src_ = StrView(*owned_src_);
+}
+
+
+void Rule::write_with_patched_chain(std::ostream& out,
+    const std::string& chain) const {
+
+  if (chain_offset_ == 0) {
+    out << "-A " << chain << " " << src_;
+    return;
+  }
+  const size_t end = chain_offset_ + chain_length_;
+  out.write(src_.data(), chain_offset_);
+  out << chain;
+  out.write(src_.data() + end, src_.size() - end);
 }
 
 
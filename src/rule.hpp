@@ -3,8 +3,10 @@
 
 #include "box.hpp"
 #include "action.hpp"
+#include "mapped.hpp"
 #include <sstream>
 #include <algorithm>
+#include <memory>
   
 const dim_t ICMP = 1;
 const dim_t TCP = 6;
@@ -26,25 +28,32 @@ typedef std::vector<Rule*> RuleVector;
 typedef std::vector<RuleVector> ChainVector;
 typedef std::tuple<size_t, size_t> DomainTuple;
 typedef std::vector<DomainTuple> DomainVector;
+typedef std::vector<uint32_t> PositionVector;
 
 class Rule {
 public:
-  Rule(const Action& action, const Box& box, const std::string& src) 
+  /*
+   * A rule only refers to its source text, which has to outlive the rule
+   * unless the rule copies it with copy_src.
+   */
+  Rule(const Action& action, const Box& box, const StrView& src)
       : action_(action), box_(box), applicable_(true), chain_(""), src_(src),
-      protocol_(PROTOCOL_WILDCARD) {}
+      chain_offset_(0), chain_length_(0), protocol_(PROTOCOL_WILDCARD) {}
 
   Rule(const Action& action, const DimVector& dims, const std::string& chain,
-      const std::string& src, const size_t protocol)
+      const StrView& src, const size_t protocol)
       : action_(action), box_(dims), applicable_(true), chain_(chain),
-      src_(src), protocol_(protocol) {}
+      src_(src), chain_offset_(0), chain_length_(0), protocol_(protocol) {}
 
-  Rule(const std::string& src, const std::string& chain) :
+  Rule(const StrView& src, const std::string& chain) :
       action_(Action(NONE)), box_(DimVector()), applicable_(false),
-      chain_(chain), src_(src), protocol_(PROTOCOL_WILDCARD) {}
+      chain_(chain), src_(src), chain_offset_(0), chain_length_(0),
+      protocol_(PROTOCOL_WILDCARD) {}
 
   // XXX this constructor should be removed
-  Rule(const std::string& src) : action_(Action(NONE)), box_(DimVector()),
-      applicable_(false), chain_(""), src_(src), protocol_(PROTOCOL_WILDCARD) {}
+  Rule(const StrView& src) : action_(Action(NONE)), box_(DimVector()),
+      applicable_(false), chain_(""), src_(src), chain_offset_(0),
+      chain_length_(0), protocol_(PROTOCOL_WILDCARD) {}
 
   inline const Action& action() const {return action_;}
 
@@ -57,16 +66,56 @@ public:
   static size_t num_distinct_rules_in_dim(const size_t dim,
       std::vector<const Rule*>& rules);
 
+  /*
+   * Like num_distinct_rules_in_dim, but takes the rules' intervals in one
+   * dimension, sorted by their start points.
+   */
+  static size_t num_distinct_sorted_intervals(
+      const std::vector<DimTuple>& intervals);
+
   static void cut_points(const size_t dim, std::vector<const Rule*>& rules,
       std::vector<dim_t>& cut_points);
 
+  /*
+   * Like cut_points, but takes the rules' intervals in one dimension, sorted
+   * by their start points.
+   */
+  static void sorted_interval_cut_points(
+      const std::vector<DimTuple>& intervals, std::vector<dim_t>& cut_points);
+
+  /*
+   * Stores the intervals of the given rules in the given dimension.
+   */
+  static void intervals_in_dim(const size_t dim,
+      const std::vector<const Rule*>& rules, std::vector<DimTuple>& intervals);
+
   bool operator==(const Rule& other) const;
 
   inline bool operator!=(const Rule& other) const {return !(*this == other);}
 
-  inline const std::string& src() const {return src_;}
+  inline const StrView& src() const {return src_;}
+
+  /*
+   * Makes the rule keep its own copy of its source text, so that the text it
+   * was parsed from may go away before the rule.
+   */
+  void copy_src();
 
-  std::string src_with_patched_chain(const std::string& chain) const;
+  /*
+   * Marks the chain name, i.e. the word after -A, within the source text.
+   */
+  inline void set_chain_span(const size_t offset, const size_t length) {
+    chain_offset_ = offset;
+    chain_length_ = length;
+  }
+
+  /*
+   * Writes the source text with the chain name replaced by the given chain:
+   * the text before the chain name, the new name and the text after it.
+   * Without a chain name in the source, "-A <chain>" is put in front.
+   */
+  void write_with_patched_chain(std::ostream& out,
+      const std::string& chain) const;
 
   static void delete_rules(RuleVector& rules);
 
@@ -83,7 +132,11 @@ private:
   Box box_;
   const bool applicable_;
   std::string chain_;
-  std::string src_;
+  StrView src_;
+  // the source text, if the rule keeps its own copy of it
+  std::shared_ptr<const std::string> owned_src_;
+  uint32_t chain_offset_;
+  uint32_t chain_length_;
   size_t protocol_;
 };
 
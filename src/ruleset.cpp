@@ -0,0 +1,112 @@
+#include "ruleset.hpp"
+#include <algorithm>
+#include <string>
+
+uint32_t RuleSet::at(const size_t i) const {
+  if (!dense_)
+    return words_[i];
+  size_t remaining = i;
+  const size_t num_words = words_.size();
+  for (size_t w = 0; w < num_words; ++w) {
+    const size_t count = __builtin_popcount(words_[w]);
+    if (remaining >= count) {
+      remaining -= count;
+      continue;
+    }
+    uint32_t word = words_[w];
+    for (; remaining > 0; --remaining)
+      word &= word - 1;
+    return w * WORD_BITS + __builtin_ctz(word);
+  }
+  throw std::string("Rule set index out of range!");
+}
+
+
+void RuleSet::collect(RuleIdVector& ids) const {
+  if (!dense_) {
+    ids.insert(ids.end(), words_.begin(), words_.end());
+    return;
+  }
+  ids.reserve(ids.size() + size_);
+  const size_t num_words = words_.size();
+  for (size_t w = 0; w < num_words; ++w)
+    for (uint32_t word = words_[w]; word != 0; word &= word - 1)
+      ids.push_back(w * WORD_BITS + __builtin_ctz(word));
+}
+
+
+bool RuleSet::contains(const uint32_t id) const {
+  if (dense_)
+    return id / WORD_BITS < words_.size()
+        && ((words_[id / WORD_BITS] >> (id % WORD_BITS)) & 1);
+  return std::binary_search(words_.begin(), words_.end(), id);
+}
+
+
+size_t RuleSet::intersection_size(const RuleSet& other) const {
+  if (dense_ && other.dense()) {
+    const size_t num_words = std::min(words_.size(), other.words_.size());
+    size_t count = 0;
+    for (size_t w = 0; w < num_words; ++w)
+      count += __builtin_popcount(words_[w] & other.words_[w]);
+    return count;
+  }
+  if (dense_)
+    return other.intersection_size(*this);
+  size_t count = 0;
+  for (size_t i = 0; i < size_; ++i)
+    count += other.contains(words_[i]);
+  return count;
+}
+
+
+bool RuleSet::operator==(const RuleSet& other) const {
+  if (size_ != other.size())
+    return false;
+  if (dense_ != other.dense())
+    return intersection_size(other) == size_;
+  // bitsets are trimmed to their highest id, so equal sets have equal words
+  return words_ == other.words_;
+}
+
+
+size_t RuleSet::hash() const {
+  // FNV-1a over the ids in ascending order
+  uint64_t hash = 14695981039346656037ULL;
+  if (!dense_) {
+    for (size_t i = 0; i < size_; ++i)
+      hash = (hash ^ words_[i]) * 1099511628211ULL;
+    return hash;
+  }
+  const size_t num_words = words_.size();
+  for (size_t w = 0; w < num_words; ++w)
+    for (uint32_t word = words_[w]; word != 0; word &= word - 1)
+      hash = (hash ^ (w * WORD_BITS + __builtin_ctz(word))) * 1099511628211ULL;
+  return hash;
+}
+
+
+void RuleSet::compact(const size_t table_size) {
+  if (dense_ || size_ == 0 || words_.back() >= table_size)
+    return;
+  const size_t num_words = words_.back() / WORD_BITS + 1;
+  if (num_words >= size_) {
+    words_.shrink_to_fit();
+    return;
+  }
+  RuleIdVector bits(num_words, 0);
+  for (size_t i = 0; i < size_; ++i)
+    bits[words_[i] / WORD_BITS] |= 1U << (words_[i] % WORD_BITS);
+  words_.swap(bits);
+  dense_ = true;
+}
+
+
+void RuleSet::to_list() {
+  if (!dense_)
+    return;
+  RuleIdVector ids;
+  collect(ids);
+  words_.swap(ids);
+  dense_ = false;
+}
@@ -0,0 +1,101 @@
+#ifndef HITABLES_RULESET_HPP
+#define HITABLES_RULESET_HPP 1
+
+#include <cstdlib>
+#include <vector>
+#include <string>
+#include "ruletable.hpp"
+
+/*
+ * The rules of a tree node as ascending ids into the tree's RuleTable.  A
+ * set starts out as a plain id list, which is compact for sparse nodes and
+ * offers random access by position, as needed while the node is cut.
+ * compact() switches the set to a bitset up to its highest id whenever that
+ * takes less memory, i.e. when the node holds more than one in 32 of the
+ * rules up to there.  Bitsets answer membership, counting and comparison
+ * word-parallel.
+ */
+class RuleSet {
+public:
+  RuleSet() : size_(0), dense_(false) {}
+
+  /*
+   * Number of ids per bitset word.
+   */
+  static const uint32_t WORD_BITS = 32;
+
+  inline size_t size() const {return size_;}
+
+  inline bool empty() const {return size_ == 0;}
+
+  inline bool dense() const {return dense_;}
+
+  /*
+   * The ids in ascending order.  Only available in list form.
+   * Throws an std::string in bitset form; use collect or at there.
+   */
+  inline const RuleIdVector& ids() const {
+    if (dense_)
+      throw std::string("Rule set ids are not available in bitset form!");
+    return words_;
+  }
+
+  /*
+   * Appends an id that is larger than all ids in the set.  Switches the set
+   * to list form first if necessary.  A set holds at most 2^32 - 1 ids.
+   */
+  inline void push_back(const uint32_t id) {
+    if (dense_)
+      to_list();
+    words_.push_back(id);
+    ++size_;
+  }
+
+  /*
+   * Returns the i-th smallest id.  Takes time linear in the size of the
+   * table in bitset form.
+   */
+  uint32_t at(const size_t i) const;
+
+  /*
+   * Appends all ids in ascending order to the given vector.
+   */
+  void collect(RuleIdVector& ids) const;
+
+  bool contains(const uint32_t id) const;
+
+  /*
+   * Counts the ids that both sets contain.
+   */
+  size_t intersection_size(const RuleSet& other) const;
+
+  bool operator==(const RuleSet& other) const;
+
+  inline bool operator!=(const RuleSet& other) const {
+    return !(*this == other);
+  }
+
+  /*
+   * Hashes the ids, so that equal sets have equal hashes in either form.
+   */
+  size_t hash() const;
+
+  /*
+   * Switches to bitset form if that takes less memory than the id list, and
+   * trims the list otherwise.  Ids must be smaller than table_size.
+   */
+  void compact(const size_t table_size);
+
+  /*
+   * Switches back to list form.
+   */
+  void to_list();
+
+private:
+  uint32_t size_;
+  bool dense_;
+  // the ids in list form, or the bitset words in bitset form
+  RuleIdVector words_;
+};
+
+#endif // HITABLES_RULESET_HPP
@@ -0,0 +1,88 @@
+#include "ruletable.hpp"
+
+TableBox::TableBox(const Box& box) {
+  const DimVector& bounds = box.box_bounds();
+  const size_t num_dims = bounds.size();
+  for (size_t dim = 0; dim < RuleTable::NUM_DIMS; ++dim) {
+    starts_[dim] = dim < num_dims ? std::get<0>(bounds[dim]) : 0;
+    ends_[dim] = dim < num_dims ? std::get<1>(bounds[dim]) : UINT32_MAX;
+  }
+}
+
+
+TableBox::TableBox(const Box& box, const size_t dim, const DimTuple& slice)
+    : TableBox(box) {
+  starts_[dim] = std::get<0>(slice);
+  ends_[dim] = std::get<1>(slice);
+}
+
+
+uint32_t RuleTable::add(const Rule* rule) {
+  const DimVector& bounds = rule->box().box_bounds();
+  const size_t num_dims = bounds.size();
+  if (num_dims > NUM_DIMS) {
+    std::stringstream error;
+    error << "Rule has " << num_dims << " dimensions, at most " << NUM_DIMS
+        << " are supported!";
+    throw error.str();
+  }
+  if (rules_.size() >= UINT32_MAX)
+    throw std::string("Too many rules: rule ids exceed 32 bits!");
+  for (size_t dim = 0; dim < NUM_PORT_DIMS; ++dim) {
+    const dim_t start = dim < num_dims ? std::get<0>(bounds[dim]) : min_port;
+    const dim_t end = dim < num_dims ? std::get<1>(bounds[dim]) : max_port;
+    if (start > max_port || end > max_port) {
+      std::stringstream error;
+      error << "Rule bound in dimension " << dim << " exceeds " << max_port
+          << "!";
+      throw error.str();
+    }
+    port_starts_[dim].push_back(start);
+    port_ends_[dim].push_back(end);
+  }
+  for (size_t dim = NUM_PORT_DIMS; dim < NUM_DIMS; ++dim) {
+    const dim_t start = dim < num_dims ? std::get<0>(bounds[dim]) : min_ip;
+    const dim_t end = dim < num_dims ? std::get<1>(bounds[dim]) : max_ip;
+    addr_starts_[dim - NUM_PORT_DIMS].push_back(start);
+    addr_ends_[dim - NUM_PORT_DIMS].push_back(end);
+  }
+  rules_.push_back(rule);
+  return rules_.size() - 1;
+}
+
+
+bool RuleTable::is_shadowed(const uint32_t id, const uint32_t other,
+    const TableBox& frame) const {
+
+  for (size_t dim = 0; dim < NUM_DIMS; ++dim) {
+    const dim_t frame_start = frame.start(dim);
+    const dim_t frame_end = frame.end(dim);
+    // clip both intervals to the frame
+    dim_t this_start = start(dim, id);
+    dim_t other_start = start(dim, other);
+    this_start = this_start < frame_start ? frame_start : this_start;
+    other_start = other_start < frame_start ? frame_start : other_start;
+    if (this_start < other_start)
+      return false;
+    dim_t this_end = end(dim, id);
+    dim_t other_end = end(dim, other);
+    this_end = this_end > frame_end ? frame_end : this_end;
+    other_end = other_end > frame_end ? frame_end : other_end;
+    if (this_end > other_end)
+      return false;
+  }
+  return true;
+}
+
+
+void RuleTable::intervals(const size_t dim, const RuleIdVector& ids,
+    const std::vector<uint32_t>& order, std::vector<DimTuple>& result) const {
+
+  const size_t num_rules = order.size();
+  result.clear();
+  result.reserve(num_rules);
+  for (size_t i = 0; i < num_rules; ++i) {
+    const uint32_t id = ids[order[i]];
+    result.push_back(std::make_tuple(start(dim, id), end(dim, id)));
+  }
+}
@@ -0,0 +1,103 @@
+#ifndef HITABLES_RULETABLE_HPP
+#define HITABLES_RULETABLE_HPP 1
+
+#include <cstdlib>
+#include <vector>
+#include "rule.hpp"
+
+typedef std::vector<uint32_t> RuleIdVector;
+
+/*
+ * A box in the fixed four-dimensional layout of a RuleTable.  Dimensions
+ * missing in the original box span the whole value range.
+ */
+class TableBox {
+public:
+  TableBox(const Box& box);
+
+  /*
+   * The piece of the given box with the given slice of a dimension.
+   */
+  TableBox(const Box& box, const size_t dim, const DimTuple& slice);
+
+  inline dim_t start(const size_t dim) const {return starts_[dim];}
+  inline dim_t end(const size_t dim) const {return ends_[dim];}
+
+private:
+  dim_t starts_[4];
+  dim_t ends_[4];
+};
+
+
+/*
+ * The geometry of the rules of one tree in structure-of-arrays layout.  The
+ * bounds of the four dimensions (source port, destination port, source
+ * address, destination address) are kept in separate contiguous arrays that
+ * are indexed by rule id; port bounds take 16 bits each.  Rules with fewer
+ * dimensions are padded with full-range intervals, which neither affects
+ * collisions nor shadowing.
+ */
+class RuleTable {
+public:
+  static const size_t NUM_DIMS = 4;
+  static const size_t NUM_PORT_DIMS = 2;
+
+  /*
+   * Appends the given rule and returns its id.  Throws an error message if
+   * a port bound does not fit into 16 bits or the rule has more than
+   * NUM_DIMS dimensions.
+   */
+  uint32_t add(const Rule* rule);
+
+  inline size_t size() const {return rules_.size();}
+
+  inline const Rule* rule(const uint32_t id) const {return rules_[id];}
+
+  inline dim_t start(const size_t dim, const uint32_t id) const {
+    return dim < NUM_PORT_DIMS ? port_starts_[dim][id]
+                               : addr_starts_[dim - NUM_PORT_DIMS][id];
+  }
+
+  inline dim_t end(const size_t dim, const uint32_t id) const {
+    return dim < NUM_PORT_DIMS ? port_ends_[dim][id]
+                               : addr_ends_[dim - NUM_PORT_DIMS][id];
+  }
+
+  /*
+   * Checks whether the given rule overlaps the given box.
+   */
+  inline bool collide(const uint32_t id, const TableBox& box) const {
+    for (size_t dim = 0; dim < NUM_PORT_DIMS; ++dim)
+      if (port_starts_[dim][id] > box.end(dim)
+          || port_ends_[dim][id] < box.start(dim))
+        return false;
+    for (size_t dim = 0; dim < NUM_DIMS - NUM_PORT_DIMS; ++dim)
+      if (addr_starts_[dim][id] > box.end(dim + NUM_PORT_DIMS)
+          || addr_ends_[dim][id] < box.start(dim + NUM_PORT_DIMS))
+        return false;
+    return true;
+  }
+
+  /*
+   * Checks whether rule id is shadowed by rule other within the given frame,
+   * like Rule::is_shadowed.
+   */
+  bool is_shadowed(const uint32_t id, const uint32_t other,
+      const TableBox& frame) const;
+
+  /*
+   * Stores the intervals of the given rules in the given dimension, in the
+   * order of the ids.
+   */
+  void intervals(const size_t dim, const RuleIdVector& ids,
+      const std::vector<uint32_t>& order, std::vector<DimTuple>& result) const;
+
+private:
+  std::vector<const Rule*> rules_;
+  std::vector<uint16_t> port_starts_[NUM_PORT_DIMS];
+  std::vector<uint16_t> port_ends_[NUM_PORT_DIMS];
+  std::vector<uint32_t> addr_starts_[NUM_DIMS - NUM_PORT_DIMS];
+  std::vector<uint32_t> addr_ends_[NUM_DIMS - NUM_PORT_DIMS];
+};
+
+#endif // HITABLES_RULETABLE_HPP
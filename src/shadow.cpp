@@ -0,0 +1,103 @@
+#include "shadow.hpp"
+
+const uint32_t ShadowIndex::NONE = UINT32_MAX;
+
+void ShadowIndex::make_key(const uint32_t id, std::vector<dim_t>& key) const {
+  for (size_t i = 0; i < RuleTable::NUM_DIMS; ++i) {
+    const dim_t frame_start = frame_.start(i);
+    const dim_t frame_end = frame_.end(i);
+    const dim_t start = table_.start(i, id);
+    const dim_t end = table_.end(i, id);
+    key[2 * i] = start < frame_start ? frame_start : start;
+    // complement the end, so larger intervals yield smaller coordinates
+    key[2 * i + 1] = ~(end > frame_end ? frame_end : end);
+  }
+}
+
+
+void ShadowIndex::make_collision_key(const uint32_t id,
+    std::vector<dim_t>& key) const {
+
+  for (size_t i = 0; i < RuleTable::NUM_DIMS; ++i) {
+    const dim_t frame_start = frame_.start(i);
+    const dim_t frame_end = frame_.end(i);
+    const dim_t start = table_.start(i, id);
+    const dim_t end = table_.end(i, id);
+    key[2 * i] = end > frame_end ? frame_end : end;
+    key[2 * i + 1] = ~(start < frame_start ? frame_start : start);
+  }
+}
+
+
+bool ShadowIndex::shadowed(const uint32_t id) const {
+  if (left_.empty())
+    return false;
+  make_key(id, query_key_);
+  return dominated(query_key_.data());
+}
+
+
+bool ShadowIndex::collides(const uint32_t id) const {
+  if (left_.empty())
+    return false;
+  make_collision_key(id, query_key_);
+  return dominated(query_key_.data());
+}
+
+
+bool ShadowIndex::dominated(const dim_t* query) const {
+  stack_.clear();
+  stack_.push_back(0);
+  while (!stack_.empty()) {
+    const uint32_t node = stack_.back();
+    stack_.pop_back();
+    if (!dominates(&mins_[node * NUM_KEYS], query))
+      continue;
+    const dim_t* key = &keys_[node * NUM_KEYS];
+    if (dominates(key, query))
+      return true;
+    const size_t split = split_[node];
+    // the right subtree only holds points not below this node's coordinate
+    if (right_[node] != NONE && key[split] <= query[split])
+      stack_.push_back(right_[node]);
+    if (left_[node] != NONE)
+      stack_.push_back(left_[node]);
+  }
+  return false;
+}
+
+
+void ShadowIndex::insert(const uint32_t id) {
+  const uint32_t index = left_.size();
+  keys_.resize(keys_.size() + NUM_KEYS);
+  mins_.resize(mins_.size() + NUM_KEYS);
+  make_key(id, query_key_);
+  for (size_t i = 0; i < NUM_KEYS; ++i) {
+    keys_[index * NUM_KEYS + i] = query_key_[i];
+    mins_[index * NUM_KEYS + i] = query_key_[i];
+  }
+  left_.push_back(NONE);
+  right_.push_back(NONE);
+  split_.push_back(0);
+  if (index == 0)
+    return;
+  // descend to the free slot, lowering the subtree minimums on the way
+  const dim_t* key = &keys_[index * NUM_KEYS];
+  uint32_t node = 0;
+  size_t depth = 0;
+  for (;;) {
+    dim_t* mins = &mins_[node * NUM_KEYS];
+    for (size_t i = 0; i < NUM_KEYS; ++i)
+      mins[i] = key[i] < mins[i] ? key[i] : mins[i];
+    const size_t split = split_[node];
+    std::vector<uint32_t>& next = key[split] < keys_[node * NUM_KEYS + split]
+        ? left_ : right_;
+    ++depth;
+    if (next[node] == NONE) {
+      next[node] = index;
+      split_[index] = depth % NUM_KEYS;
+      return;
+    }
+    node = next[node];
+  }
+}
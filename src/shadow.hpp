@@ -0,0 +1,84 @@
+#ifndef HITABLES_SHADOW_HPP
+#define HITABLES_SHADOW_HPP 1
+
+#include <cstdlib>
+#include <vector>
+#include "ruletable.hpp"
+
+/*
+ * Answers whether a rule of a RuleTable is shadowed by one of the rules
+ * inserted before within a fixed frame, as Rule::is_shadowed does for a
+ * single pair.
+ * Clipped to the frame, a rule becomes a point made of its interval starts
+ * and its complemented interval ends; rule a shadows rule b exactly if a's
+ * point is less than or equal to b's in every coordinate.  The points are
+ * kept in a k-d tree whose nodes also store the coordinate-wise minimum of
+ * their subtree, so a query skips every subtree that cannot hold a
+ * dominating point.
+ * The same points answer whether a rule overlaps an inserted one: rule a
+ * overlaps rule b exactly if a's point is less than or equal to the point
+ * made of b's interval ends and its complemented interval starts.
+ */
+class ShadowIndex {
+public:
+  ShadowIndex(const RuleTable& table, const TableBox& frame)
+      : table_(table), frame_(frame), query_key_(NUM_KEYS) {}
+
+  /*
+   * Checks whether the given rule is shadowed by any inserted rule.
+   */
+  bool shadowed(const uint32_t id) const;
+
+  /*
+   * Checks whether the given rule overlaps any inserted rule within the
+   * frame.
+   */
+  bool collides(const uint32_t id) const;
+
+  void insert(const uint32_t id);
+
+  inline size_t size() const {return left_.size();}
+
+private:
+  static const uint32_t NONE;
+
+  static const size_t NUM_KEYS = 2 * RuleTable::NUM_DIMS;
+
+  const RuleTable& table_;
+  TableBox frame_;
+  // NUM_KEYS coordinates per point
+  std::vector<dim_t> keys_;
+  std::vector<dim_t> mins_;
+  std::vector<uint32_t> left_;
+  std::vector<uint32_t> right_;
+  std::vector<uint8_t> split_;
+  // scratch space for queries
+  mutable std::vector<dim_t> query_key_;
+  mutable std::vector<uint32_t> stack_;
+
+  /*
+   * Computes the point of the given rule.
+   */
+  void make_key(const uint32_t id, std::vector<dim_t>& key) const;
+
+  /*
+   * Computes the point that the points of all rules overlapping the given
+   * rule are less than or equal to.
+   */
+  void make_collision_key(const uint32_t id, std::vector<dim_t>& key) const;
+
+  /*
+   * Checks whether any inserted point is less than or equal to the given one
+   * in every coordinate.
+   */
+  bool dominated(const dim_t* query) const;
+
+  static inline bool dominates(const dim_t* a, const dim_t* b) {
+    for (size_t i = 0; i < NUM_KEYS; ++i)
+      if (a[i] > b[i])
+        return false;
+    return true;
+  }
+};
+
+#endif // HITABLES_SHADOW_HPP
@@ -4,6 +4,9 @@
 #include "arg.hpp"
 #include <cstdio>
 #include "emit.hpp"
+#include "pool.hpp"
+#include "tune.hpp"
+#include <atomic>
 
 #define BOOST_TEST_DYN_LINK
 #define BOOST_TEST_MODULE hitables_tests
@@ -169,6 +172,35 @@ BOOST_AUTO_TEST_CASE(box_unequal_cut) {
 }
 
 
+BOOST_AUTO_TEST_CASE(box_cut_slices) {
+  DimVector bounds;
+  bounds.push_back(make_tuple(1, 7));
+  bounds.push_back(make_tuple(3, 5));
+  Box box(bounds);
+  DimVector slices;
+  box.cut_slices(0, 2, slices);
+  BOOST_CHECK_EQUAL(slices.size(), 3);
+  BOOST_CHECK(slices[0] == make_tuple(1, 3));
+  BOOST_CHECK(slices[1] == make_tuple(4, 6));
+  BOOST_CHECK(slices[2] == make_tuple(7, 7));
+  vector<dim_t> cut_points;
+  cut_points.push_back(4);
+  box.unequal_cut_slices(1, cut_points, slices);
+  BOOST_CHECK_EQUAL(slices.size(), 2);
+  BOOST_CHECK(slices[0] == make_tuple(3, 4));
+  BOOST_CHECK(slices[1] == make_tuple(5, 5));
+  // the pieces are the boxes that cut produces
+  const Box piece(box.piece(1, slices[1]));
+  BOOST_CHECK(piece.box_bounds()[0] == make_tuple(1, 7));
+  BOOST_CHECK(piece.box_bounds()[1] == make_tuple(5, 5));
+  vector<Box> result_boxes;
+  box.cut(0, 2, result_boxes);
+  box.cut_slices(0, 2, slices);
+  for (size_t i = 0; i < slices.size(); ++i)
+    BOOST_CHECK(box.piece(0, slices[i]) == result_boxes[i]);
+}
+
+
 ///BOOST_AUTO_TEST_CASE(box_unequal_cut_regression) {
 ///  DimVector bounds;
 ///  bounds.push_back();
@@ -197,12 +229,11 @@ BOOST_AUTO_TEST_CASE(action_assignment) {
 BOOST_AUTO_TEST_CASE(treenode_cut) {
   SINGLE_DIM_NODE_WITH_THREE_RULES;
   node.cut(0, 1);
-  const std::vector<TreeNode>& children = node.children();
-  BOOST_CHECK_EQUAL(children.size(), 2);
-  BOOST_CHECK(*children[0].rules()[0] == rule1);
-  BOOST_CHECK(*children[0].rules()[1] == rule2);
-  BOOST_CHECK(*children[1].rules()[0] == rule2);
-  BOOST_CHECK(*children[1].rules()[1] == rule3);
+  BOOST_CHECK_EQUAL(node.num_children(), 2);
+  BOOST_CHECK(*node.child(0).rules()[0] == rule1);
+  BOOST_CHECK(*node.child(0).rules()[1] == rule2);
+  BOOST_CHECK(*node.child(1).rules()[0] == rule2);
+  BOOST_CHECK(*node.child(1).rules()[1] == rule3);
 }
 
 
@@ -219,9 +250,8 @@ BOOST_AUTO_TEST_CASE(treenode_cut_small_rules) {
     rule_pointers.push_back(rule);
   }
   node.cut(0, 4);
-  const std::vector<TreeNode>& children = node.children();
-  BOOST_CHECK_EQUAL(children.size(), 4);
-  BOOST_CHECK_EQUAL(children[0].rules().size(), 3);
+  BOOST_CHECK_EQUAL(node.num_children(), 4);
+  BOOST_CHECK_EQUAL(node.child(0).rules().size(), 3);
   for (size_t i = 0; i < 10; ++i)
     delete rule_pointers[i];
 }
@@ -237,16 +267,15 @@ BOOST_AUTO_TEST_CASE(treenode_unequal_cut) {
 
   node.unequal_cut(0, cut_points);
   BOOST_CHECK(node.has_been_cut());
-  const vector<TreeNode>& children = node.children();
-  BOOST_CHECK_EQUAL(children.size(), 3);
-  BOOST_CHECK_EQUAL(children[0].rules().size(), 1);
-  BOOST_CHECK(*children[0].rules()[0] == rule1);
+  BOOST_CHECK_EQUAL(node.num_children(), 3);
+  BOOST_CHECK_EQUAL(node.child(0).rules().size(), 1);
+  BOOST_CHECK(*node.child(0).rules()[0] == rule1);
 
-  BOOST_CHECK_EQUAL(children[1].rules().size(), 1);
-  BOOST_CHECK(*children[1].rules()[0] == rule2);
+  BOOST_CHECK_EQUAL(node.child(1).rules().size(), 1);
+  BOOST_CHECK(*node.child(1).rules()[0] == rule2);
 
-  BOOST_CHECK_EQUAL(children[2].rules().size(), 1);
-  BOOST_CHECK(*children[2].rules()[0] == rule3);
+  BOOST_CHECK_EQUAL(node.child(2).rules().size(), 1);
+  BOOST_CHECK(*node.child(2).rules()[0] == rule3);
 }
 
 
@@ -268,7 +297,7 @@ BOOST_AUTO_TEST_CASE(treenode_unequal_cut_no_cut_possible) {
 
   node.unequal_cut(0, cut_points);
   BOOST_CHECK(!node.has_been_cut());
-  BOOST_CHECK(node.children().empty());
+  BOOST_CHECK(node.is_leaf());
 }
 
 
@@ -292,8 +321,7 @@ BOOST_AUTO_TEST_CASE(treenode_cut_does_not_add_empty_child_nodes) {
   // now cut the node 9 times in first dimension
   node.cut(0, 9);
   // the node should now have only 2 children instead of 10
-  const NodeVector& children = node.children();
-  BOOST_CHECK_EQUAL(children.size(), 2);
+  BOOST_CHECK_EQUAL(node.num_children(), 2);
 }
 
 
@@ -311,13 +339,13 @@ BOOST_AUTO_TEST_CASE(treenode_reset_cut) {
   SINGLE_DIM_NODE_WITH_THREE_RULES;
   node.cut(0, 1);
   // node has been cut, so it should have child nodes
-  BOOST_CHECK(!node.children().empty());
+  BOOST_CHECK(!node.is_leaf());
   node.reset_cut();
   // the cut has been reset, so there should be no child nodes
-  BOOST_CHECK(node.children().empty());
+  BOOST_CHECK(node.is_leaf());
   // cut the node again, so it should have children
   node.cut(0, 1);
-  BOOST_CHECK(!node.children().empty());
+  BOOST_CHECK(!node.is_leaf());
 }
 
 
@@ -452,6 +480,32 @@ BOOST_AUTO_TEST_CASE(treenode_dim_least_max_rules_per_child) {
 }
 
 
+BOOST_AUTO_TEST_CASE(treenode_least_cost_cut) {
+  DimVector bounds;
+  bounds.push_back(make_tuple(0, 10));
+  bounds.push_back(make_tuple(0, 10));
+  TreeNode node(bounds);
+  
+  DimVector rule1_bounds;
+  rule1_bounds.push_back(make_tuple(0, 10));
+  rule1_bounds.push_back(make_tuple(1, 1));
+  Rule rule1(DROP, Box(rule1_bounds), "");
+  node.add_rule(&rule1);
+
+  DimVector rule2_bounds;
+  rule2_bounds.push_back(make_tuple(0, 10));
+  rule2_bounds.push_back(make_tuple(8, 8));
+  Rule rule2(DROP, Box(rule2_bounds), "");
+  node.add_rule(&rule2);
+
+  // cutting dimension 0 copies both rules into every child
+  size_t num_cuts = 0;
+  const size_t dim = node.least_cost_cut(1, 1, num_cuts);
+  BOOST_CHECK_EQUAL(dim, 1);
+  BOOST_CHECK_EQUAL(num_cuts, 4);
+}
+
+
 BOOST_AUTO_TEST_CASE(treenode_most_distinct_projection_points) {
   DimVector bounds;
   bounds.push_back(make_tuple(2, 5));
@@ -613,33 +667,52 @@ BOOST_AUTO_TEST_CASE(treenode_compute_numbering) {
   root.compute_numbering();
   BOOST_CHECK_EQUAL(root.id(), 0);
   
-  TreeNode root_child_2(dims);
-  root_child_2.add_child(TreeNode(dims));
-  root_child_2.add_child(TreeNode(dims));
+  Box box(dims);
+  root.add_child(box);
+  root.add_child(box);
+  root.add_child(box);
 
-  TreeNode root_child_3(dims);
-  root_child_3.add_child(TreeNode(dims));
+  root.child(1).add_child(box);
+  root.child(1).add_child(box);
 
-  root.add_child(TreeNode(dims));
-  root.add_child(TreeNode(root_child_2));
-  root.add_child(TreeNode(root_child_3));
+  root.child(2).add_child(box);
   
   root.compute_numbering();
   BOOST_CHECK_EQUAL(root.id(), 0);
-  NodeVector& root_children = root.children();
-  BOOST_CHECK_EQUAL(root_children.size(), 3);
-  BOOST_CHECK_EQUAL(root_children[0].id(), 1);
-  BOOST_CHECK_EQUAL(root_children[1].id(), 2);
-  BOOST_CHECK_EQUAL(root_children[2].id(), 5);
+  BOOST_CHECK_EQUAL(root.num_children(), 3);
+  BOOST_CHECK_EQUAL(root.child(0).id(), 1);
+  BOOST_CHECK_EQUAL(root.child(1).id(), 2);
+  BOOST_CHECK_EQUAL(root.child(2).id(), 5);
 
-  NodeVector& root_child_2_children = root_children[1].children();
-  BOOST_CHECK_EQUAL(root_child_2_children.size(), 2);
-  BOOST_CHECK_EQUAL(root_child_2_children[0].id(), 3);
-  BOOST_CHECK_EQUAL(root_child_2_children[1].id(), 4);
+  const TreeNode& root_child_2 = root.child(1);
+  BOOST_CHECK_EQUAL(root_child_2.num_children(), 2);
+  BOOST_CHECK_EQUAL(root_child_2.child(0).id(), 3);
+  BOOST_CHECK_EQUAL(root_child_2.child(1).id(), 4);
 
-  NodeVector& root_child_3_children = root_children[2].children();
-  BOOST_CHECK_EQUAL(root_child_3_children.size(), 1);
-  BOOST_CHECK_EQUAL(root_child_3_children[0].id(), 6);
+  const TreeNode& root_child_3 = root.child(2);
+  BOOST_CHECK_EQUAL(root_child_3.num_children(), 1);
+  BOOST_CHECK_EQUAL(root_child_3.child(0).id(), 6);
+}
+
+
+BOOST_AUTO_TEST_CASE(treenode_arena_add_range) {
+  NodeArena arena;
+  DimVector dims;
+  dims.push_back(make_tuple(0, 0));
+  // fill several blocks and make sure ranges stay contiguous and addressable
+  size_t expected_first = 0;
+  for (size_t n = 1; n <= 100; ++n) {
+    NodeVector nodes;
+    for (size_t i = 0; i < n; ++i) {
+      nodes.push_back(TreeNode(Box(dims), nullptr, &arena));
+      nodes.back().set_id(expected_first + i);
+    }
+    const uint32_t first = arena.add_range(nodes);
+    BOOST_CHECK_EQUAL(first, expected_first);
+    expected_first += n;
+  }
+  for (size_t i = 0; i < expected_first; ++i)
+    BOOST_CHECK_EQUAL(arena[i].id(), i);
 }
 
 
@@ -681,11 +754,1099 @@ BOOST_AUTO_TEST_CASE(treenode_build_tree_with_rule_redundancies) {
   TreeNode tree(rules, domain);
   tree.build_tree(4, 1, Arguments::DIM_CHOICE_MAX_DISTINCT,
       Arguments::CUT_ALGO_EQUIDISTANT);
-  BOOST_CHECK_EQUAL(tree.children().size(), 0);
+  BOOST_CHECK_EQUAL(tree.num_children(), 0);
   BOOST_CHECK_EQUAL(tree.num_rules(), 1);
   Rule::delete_rules(rules);
 }
 
+BOOST_AUTO_TEST_CASE(treenode_tree_seed) {
+  BOOST_CHECK_EQUAL(TreeNode::tree_seed(3, 1, 2), TreeNode::tree_seed(3, 1, 2));
+  BOOST_CHECK(TreeNode::tree_seed(3, 1, 2) != TreeNode::tree_seed(3, 2, 1));
+  BOOST_CHECK(TreeNode::tree_seed(3, 1, 2) != TreeNode::tree_seed(4, 1, 2));
+}
+
+
+static void check_same_tree(TreeNode& tree1, TreeNode& tree2) {
+  NodeRefQueue fifo1;
+  NodeRefQueue fifo2;
+  fifo1.push(&tree1);
+  fifo2.push(&tree2);
+  while (!fifo1.empty() && !fifo2.empty()) {
+    TreeNode* node1 = fifo1.front();
+    TreeNode* node2 = fifo2.front();
+    fifo1.pop();
+    fifo2.pop();
+    BOOST_CHECK(node1->box() == node2->box());
+    BOOST_CHECK_EQUAL(node1->num_rules(), node2->num_rules());
+    BOOST_REQUIRE_EQUAL(node1->num_children(), node2->num_children());
+    for (size_t i = 0; i < node1->num_children(); ++i) {
+      fifo1.push(&node1->child(i));
+      fifo2.push(&node2->child(i));
+    }
+  }
+  BOOST_CHECK(fifo1.empty() && fifo2.empty());
+}
+
+
+static void grid_rules(const size_t n, RuleVector& rules,
+    const size_t sport_step = 100) {
+  for (size_t i = 0; i < n; ++i) {
+    stringstream ss;
+    ss << "-A bla -p tcp --sport " << (i % 8) * sport_step << ":"
+        << (i % 8) * sport_step + 99
+        << " --dport " << (i / 8) * 10 << ":" << (i / 8) * 10 + 9
+        << " -j DROP";
+    rules.push_back(parse::parse_rule(ss.str()));
+  }
+}
+
+
+/*
+ * Builds a tree over the given rules with spfac and binth 4, serially and on
+ * four workers.  Checks that both trees are the same and that every leaf
+ * holds at most binth rules, and passes every inner node of the serial tree
+ * with its depth to check_inner.
+ */
+static void check_built_tree(const RuleVector& rules, const size_t dim_choice,
+    const size_t cut_algo, const bool compact_regions,
+    const std::function<void(TreeNode&, const size_t)>& check_inner) {
+
+  const DomainTuple domain(make_tuple(0, rules.size() - 1));
+  TreeNode serial(rules, domain);
+  TreeNode parallel(rules, domain);
+  serial.build_tree(4, 4, dim_choice, cut_algo, 1, compact_regions);
+  parallel.build_tree(4, 4, dim_choice, cut_algo, 4, compact_regions);
+  BOOST_CHECK(!serial.is_leaf());
+  check_same_tree(serial, parallel);
+  std::stack<std::tuple<TreeNode*, size_t>> stack;
+  stack.push(make_tuple(&serial, 0));
+  while (!stack.empty()) {
+    TreeNode* node = get<0>(stack.top());
+    const size_t depth = get<1>(stack.top());
+    stack.pop();
+    if (node->is_leaf()) {
+      BOOST_CHECK(node->num_rules() <= 4);
+      continue;
+    }
+    check_inner(*node, depth);
+    for (size_t i = 0; i < node->num_children(); ++i)
+      stack.push(make_tuple(&node->child(i), depth + 1));
+  }
+}
+
+
+BOOST_AUTO_TEST_CASE(treenode_build_tree_same_seed_same_tree) {
+  RuleVector rules;
+  grid_rules(64, rules);
+  DomainTuple domain(make_tuple(0, 63));
+  TreeNode tree1(rules, domain);
+  TreeNode tree2(rules, domain);
+  tree1.seed_rng(TreeNode::tree_seed(7, 0, 0));
+  tree2.seed_rng(TreeNode::tree_seed(7, 0, 0));
+  tree1.build_tree(4, 2, Arguments::DIM_CHOICE_MAX_DISTINCT,
+      Arguments::CUT_ALGO_EQUIDISTANT);
+  tree2.build_tree(4, 2, Arguments::DIM_CHOICE_MAX_DISTINCT,
+      Arguments::CUT_ALGO_EQUIDISTANT);
+  check_same_tree(tree1, tree2);
+  Rule::delete_rules(rules);
+}
+
+
+BOOST_AUTO_TEST_CASE(treenode_child_seed) {
+  BOOST_CHECK_EQUAL(TreeNode::child_seed(3, 1), TreeNode::child_seed(3, 1));
+  BOOST_CHECK(TreeNode::child_seed(3, 1) != TreeNode::child_seed(3, 2));
+  BOOST_CHECK(TreeNode::child_seed(3, 1) != TreeNode::child_seed(4, 1));
+  // the children are seeded by their path from the root
+  RuleVector rules;
+  grid_rules(64, rules);
+  TreeNode tree(rules, make_tuple(0, 63));
+  tree.seed_rng(TreeNode::tree_seed(7, 0, 0));
+  tree.build_tree(4, 2, Arguments::DIM_CHOICE_MAX_DISTINCT,
+      Arguments::CUT_ALGO_EQUIDISTANT);
+  BOOST_REQUIRE(!tree.is_leaf());
+  BOOST_CHECK_EQUAL(tree.seed(), TreeNode::tree_seed(7, 0, 0));
+  for (size_t i = 0; i < tree.num_children(); ++i)
+    BOOST_CHECK_EQUAL(tree.child(i).seed(),
+        TreeNode::child_seed(tree.seed(), i));
+  Rule::delete_rules(rules);
+}
+
+
+BOOST_AUTO_TEST_CASE(treenode_build_tree_work_stealing) {
+  RuleVector rules;
+  grid_rules(256, rules);
+  DomainTuple domain(make_tuple(0, 255));
+  const size_t cut_algos[2] = {Arguments::CUT_ALGO_EQUIDISTANT,
+                               Arguments::CUT_ALGO_UNEQUAL};
+  for (size_t i = 0; i < 2; ++i) {
+    TreeNode serial(rules, domain);
+    TreeNode parallel(rules, domain);
+    serial.build_tree(4, 1, Arguments::DIM_CHOICE_MAX_DISTINCT, cut_algos[i]);
+    parallel.build_tree(4, 1, Arguments::DIM_CHOICE_MAX_DISTINCT,
+        cut_algos[i], 4);
+    BOOST_CHECK(!parallel.is_leaf());
+    check_same_tree(serial, parallel);
+  }
+  Rule::delete_rules(rules);
+}
+
+
+BOOST_AUTO_TEST_CASE(treenode_build_tree_unequal_fallback) {
+  RuleVector rules;
+  rules.push_back(parse::parse_rule(
+      "-A bla -p udp --sport 9937:25145 -j DROP"));
+  rules.push_back(parse::parse_rule(
+      "-A bla -p udp --dst 196.0.0.0/8 -j ACCEPT"));
+  rules.push_back(parse::parse_rule(
+      "-A bla -p udp --dst 74.170.134.0/23 -j ACCEPT"));
+  rules.push_back(parse::parse_rule(
+      "-A bla -p udp --dport 48909:49005 -j ACCEPT"));
+  rules.push_back(parse::parse_rule(
+      "-A bla -p udp --src 1.46.182.94/32 --dst 113.243.196.180/30"
+      " --dport 56352 -j DROP"));
+  rules.push_back(parse::parse_rule(
+      "-A bla -p udp --src 129.136.184.0/24 --sport 12383:54500 -j DROP"));
+  rules.push_back(parse::parse_rule(
+      "-A bla -p udp --dst 176.214.153.89/32 --sport 46226 --dport 26817"
+      " -j ACCEPT"));
+  rules.push_back(parse::parse_rule("-A bla -p udp -j ACCEPT"));
+  // some nodes have neither distinct rules nor projection points to cut at
+  // and fall back to an equidistant cut, whose inner children still need
+  // their orderings
+  TreeNode tree(rules, make_tuple(0, rules.size() - 1));
+  tree.build_tree(4, 2, Arguments::DIM_CHOICE_MAX_DISTINCT,
+      Arguments::CUT_ALGO_UNEQUAL);
+  NodeRefQueue fifo;
+  fifo.push(&tree);
+  while (!fifo.empty()) {
+    TreeNode* node = fifo.front();
+    fifo.pop();
+    if (node->is_leaf())
+      BOOST_CHECK(node->num_rules() <= 2);
+    for (size_t i = 0; i < node->num_children(); ++i)
+      fifo.push(&node->child(i));
+  }
+  Rule::delete_rules(rules);
+}
+
+BOOST_AUTO_TEST_CASE(treenode_cut_sweep) {
+  RuleVector rules;
+  grid_rules(64, rules);
+  const size_t num_cuts_list[] = {1, 15, 1000};
+  for (size_t n = 0; n < 3; ++n) {
+    for (size_t dim = 0; dim < 2; ++dim) {
+      TreeNode node(rules, make_tuple(0, rules.size() - 1));
+      node.cut(dim, num_cuts_list[n]);
+      // every child holds exactly the grid rules that collide with its box,
+      // and neighbouring slices with the same rules make up one child
+      std::vector<Box> boxes;
+      node.box().cut(dim, num_cuts_list[n], boxes);
+      std::vector<Box> expected_boxes;
+      std::vector<std::vector<const Rule*>> expected_rules;
+      bool previous_kept = false;
+      for (size_t i = 0; i < boxes.size(); ++i) {
+        std::vector<const Rule*> expected;
+        for (size_t j = 0; j < rules.size(); ++j)
+          if (rules[j]->box().collide(boxes[i]))
+            expected.push_back(rules[j]);
+        if (expected.empty()) {
+          previous_kept = false;
+          continue;
+        }
+        if (previous_kept && expected == expected_rules.back())
+          expected_boxes.back() = node.box().piece(dim, make_tuple(
+              std::get<0>(expected_boxes.back().box_bounds()[dim]),
+              std::get<1>(boxes[i].box_bounds()[dim])));
+        else {
+          expected_boxes.push_back(boxes[i]);
+          expected_rules.push_back(expected);
+        }
+        previous_kept = true;
+      }
+      BOOST_REQUIRE_EQUAL(node.num_children(), expected_boxes.size());
+      for (size_t i = 0; i < expected_boxes.size(); ++i) {
+        BOOST_CHECK(node.child(i).box() == expected_boxes[i]);
+        BOOST_CHECK(node.child(i).rules() == expected_rules[i]);
+      }
+    }
+  }
+  Rule::delete_rules(rules);
+}
+
+
+BOOST_AUTO_TEST_CASE(treenode_cut_merges_identical_children) {
+  RuleVector rules;
+  rules.push_back(parse::parse_rule("-A CHAIN -p tcp --sport 0:9 -j DROP"));
+  rules.push_back(parse::parse_rule("-A CHAIN -p tcp --sport 10:39 -j ACCEPT"));
+  rules.push_back(parse::parse_rule("-A CHAIN -p tcp --sport 40:49 -j DROP"));
+  TreeNode node(rules, make_tuple(0, rules.size() - 1));
+  std::vector<PositionVector> positions;
+  node.cut(0, 4, &positions);
+  // the three slices of the second rule share one child
+  BOOST_REQUIRE_EQUAL(node.num_children(), 3);
+  BOOST_CHECK(node.child(0).box().box_bounds()[0] == make_tuple(0, 9));
+  BOOST_CHECK(node.child(1).box().box_bounds()[0] == make_tuple(10, 39));
+  BOOST_CHECK(node.child(2).box().box_bounds()[0] == make_tuple(40, 49));
+  BOOST_REQUIRE_EQUAL(node.child(1).num_rules(), 1);
+  BOOST_CHECK(node.child(1).rules()[0] == rules[1]);
+  BOOST_REQUIRE_EQUAL(positions.size(), 3);
+  BOOST_CHECK(positions[1] == PositionVector({1}));
+  Rule::delete_rules(rules);
+}
+
+
+BOOST_AUTO_TEST_CASE(treenode_cut_merge_keeps_progress) {
+  RuleVector rules;
+  rules.push_back(parse::parse_rule(
+      "-A bla -p udp --src 152.0.0.0/7 --dst 31.0.0.0/8 --sport 50000:59999"
+      " -j ACCEPT"));
+  rules.push_back(parse::parse_rule(
+      "-A bla -p udp --sport 10000:56999 -j DROP"));
+  rules.push_back(parse::parse_rule("-A bla -p udp -j DROP"));
+  rules.push_back(parse::parse_rule("-A bla -p udp --dport 0:9 -j DROP"));
+  rules.push_back(parse::parse_rule("-A bla -p udp --dport 5:19 -j ACCEPT"));
+  // every slice receives both rules, but merging all of them would only
+  // repeat this node
+  TreeNode node(rules, make_tuple(3, 4));
+  node.cut(0, 3);
+  BOOST_REQUIRE_EQUAL(node.num_children(), 2);
+  BOOST_CHECK(node.child(0).box().box_bounds()[0] == make_tuple(0, 49151));
+  BOOST_CHECK(node.child(1).box().box_bounds()[0] == make_tuple(49152, 65535));
+  // such nodes are cut into ever smaller pieces until the tree is built
+  TreeNode tree(rules, make_tuple(0, 2));
+  tree.build_tree(4, 2, Arguments::DIM_CHOICE_MAX_DISTINCT,
+      Arguments::CUT_ALGO_EQUIDISTANT);
+  NodeRefQueue fifo;
+  fifo.push(&tree);
+  while (!fifo.empty()) {
+    TreeNode* node = fifo.front();
+    fifo.pop();
+    if (node->is_leaf())
+      BOOST_CHECK(node->num_rules() <= 2);
+    for (size_t i = 0; i < node->num_children(); ++i) {
+      BOOST_CHECK(!(node->child(i).box() == node->box()));
+      fifo.push(&node->child(i));
+    }
+  }
+  Rule::delete_rules(rules);
+}
+
+
+BOOST_AUTO_TEST_CASE(treenode_share_leaf_ids) {
+  RuleVector rules;
+  rules.push_back(parse::parse_rule("-A CHAIN -p tcp --sport 10:19 -j ACCEPT"));
+  rules.push_back(parse::parse_rule("-A CHAIN -p tcp --sport 0:29 -j DROP"));
+  TreeNode node(rules, make_tuple(0, rules.size() - 1));
+  node.cut(0, 2);
+  BOOST_REQUIRE_EQUAL(node.num_children(), 3);
+  node.compute_numbering();
+  node.share_leaf_ids();
+  // the outer children hold the second rule only
+  BOOST_CHECK_EQUAL(node.id(), 0);
+  BOOST_CHECK_EQUAL(node.child(0).id(), 1);
+  BOOST_CHECK_EQUAL(node.child(1).id(), 2);
+  BOOST_CHECK_EQUAL(node.child(2).id(), 1);
+  Rule::delete_rules(rules);
+}
+
+
+BOOST_AUTO_TEST_CASE(treenode_set_packets) {
+  SINGLE_DIM_NODE_WITH_THREE_RULES;
+  PacketSet packets;
+  const dim_t inside1[PacketSet::NUM_DIMS] = {2, 0, 0, 0};
+  const dim_t inside2[PacketSet::NUM_DIMS] = {9, 0, 0, 0};
+  const dim_t outside[PacketSet::NUM_DIMS] = {20, 0, 0, 0};
+  packets.add(inside1, 1);
+  packets.add(inside2, 3);
+  packets.add(outside, 5);
+  node.set_packets(packets);
+  BOOST_CHECK_EQUAL(node.packet_weight(), 4);
+  // the packets are passed on to the children
+  node.build_tree(4, 1, Arguments::DIM_CHOICE_COST,
+      Arguments::CUT_ALGO_EQUIDISTANT);
+  BOOST_REQUIRE(node.num_children() > 1);
+  size_t weight = 0;
+  for (size_t i = 0; i < node.num_children(); ++i) {
+    const TreeNode& child = node.child(i);
+    const dim_t start = std::get<0>(child.box().box_bounds()[0]);
+    const dim_t end = std::get<1>(child.box().box_bounds()[0]);
+    const size_t expected = (start <= 2 && 2 <= end ? 1 : 0)
+        + (start <= 9 && 9 <= end ? 3 : 0);
+    BOOST_CHECK_EQUAL(child.packet_weight(), expected);
+    weight += child.packet_weight();
+  }
+  BOOST_CHECK_EQUAL(weight, 4);
+}
+
+
+BOOST_AUTO_TEST_CASE(treenode_expected_evaluations) {
+  SINGLE_DIM_NODE_WITH_THREE_RULES;
+  // a leaf is scanned up to its fall-through jump
+  BOOST_CHECK_CLOSE(node.expected_evaluations(), 4, 1e-9);
+  // both children hold two rules and cover 6 and 5 of 11 points
+  node.cut(0, 1);
+  BOOST_REQUIRE_EQUAL(node.num_children(), 2);
+  BOOST_CHECK_CLOSE(node.expected_evaluations(), 5, 1e-9);
+}
+
+
+BOOST_AUTO_TEST_CASE(treenode_hyper_cut) {
+  RuleVector rules;
+  grid_rules(64, rules);
+  TreeNode node(rules, make_tuple(0, rules.size() - 1));
+  std::vector<size_t> dims;
+  dims.push_back(0);
+  dims.push_back(1);
+  std::vector<size_t> num_cuts;
+  num_cuts.push_back(1);
+  num_cuts.push_back(3);
+  const size_t space_measure = node.hyper_space_measure(dims, num_cuts);
+  node.hyper_cut(dims, num_cuts);
+  BOOST_CHECK(node.has_been_cut());
+  BOOST_CHECK_EQUAL(node.cut_dim(), 0);
+  BOOST_CHECK_EQUAL(node.cut_dims(), 3);
+  BOOST_CHECK_EQUAL(node.space_measure(), space_measure);
+  // the cells come in lexicographic order, the source port slice first
+  std::vector<Box> rows;
+  node.box().cut(0, 1, rows);
+  size_t num_nonempty = 0;
+  for (size_t i = 0; i < rows.size(); ++i) {
+    std::vector<Box> cells;
+    rows[i].cut(1, 3, cells);
+    for (size_t j = 0; j < cells.size(); ++j) {
+      std::vector<const Rule*> expected;
+      for (size_t k = 0; k < rules.size(); ++k)
+        if (rules[k]->box().collide(cells[j]))
+          expected.push_back(rules[k]);
+      if (expected.empty())
+        continue;
+      BOOST_REQUIRE(num_nonempty < node.num_children());
+      BOOST_CHECK(node.child(num_nonempty).box() == cells[j]);
+      BOOST_CHECK(node.child(num_nonempty).rules() == expected);
+      ++num_nonempty;
+    }
+  }
+  BOOST_CHECK_EQUAL(node.num_children(), num_nonempty);
+  Rule::delete_rules(rules);
+}
+
+
+BOOST_AUTO_TEST_CASE(treenode_determine_hyper_cuts) {
+  RuleVector rules;
+  grid_rules(64, rules);
+  TreeNode node(rules, make_tuple(0, rules.size() - 1));
+  std::vector<size_t> dims;
+  std::vector<size_t> num_cuts;
+  node.determine_hyper_cuts(4, dims, num_cuts);
+  // both port dimensions separate the grid equally well
+  BOOST_REQUIRE_EQUAL(dims.size(), 2);
+  BOOST_CHECK_EQUAL(dims[0], 0);
+  BOOST_CHECK_EQUAL(dims[1], 1);
+  BOOST_REQUIRE_EQUAL(num_cuts.size(), 2);
+  BOOST_CHECK(num_cuts[0] >= 1 && num_cuts[1] >= 1);
+  BOOST_CHECK(node.hyper_space_measure(dims, num_cuts)
+      < node.space_measure_upper_bound(4));
+  Rule::delete_rules(rules);
+}
+
+
+BOOST_AUTO_TEST_CASE(treenode_build_tree_hypercuts) {
+  RuleVector rules;
+  grid_rules(64, rules);
+  // the rules only differ in the ports, and the root cuts both of them
+  check_built_tree(rules, Arguments::DIM_CHOICE_MAX_DISTINCT,
+      Arguments::CUT_ALGO_HYPERCUTS, false,
+      [] (TreeNode& node, const size_t depth) {
+    BOOST_CHECK_EQUAL(node.cut_dims() & ~3U, 0);
+    if (depth == 0)
+      BOOST_CHECK_EQUAL(node.cut_dims(), 3);
+  });
+  Rule::delete_rules(rules);
+}
+
+
+BOOST_AUTO_TEST_CASE(treenode_build_tree_hypercuts_overlapping_rules) {
+  RuleVector rules;
+  rules.push_back(parse::parse_rule(
+      "-A bla -p tcp --src 135.153.0.0/16 --dport 17225:21321 -j ACCEPT"));
+  rules.push_back(parse::parse_rule(
+      "-A bla -p tcp --dst 25.6.246.0/24 -j ACCEPT"));
+  rules.push_back(parse::parse_rule(
+      "-A bla -p tcp --sport 16140:59889 -j DROP"));
+  // where all three rules overlap, a dimension in which they extend past the
+  // node no longer tells them apart, and cutting it would only multiply the
+  // node
+  TreeNode tree(rules, make_tuple(0, rules.size() - 1));
+  tree.build_tree(4, 2, Arguments::DIM_CHOICE_MAX_DISTINCT,
+      Arguments::CUT_ALGO_HYPERCUTS);
+  NodeRefQueue fifo;
+  fifo.push(&tree);
+  while (!fifo.empty()) {
+    TreeNode* node = fifo.front();
+    fifo.pop();
+    if (node->is_leaf())
+      BOOST_CHECK(node->num_rules() <= 2);
+    for (size_t i = 0; i < node->num_children(); ++i)
+      fifo.push(&node->child(i));
+  }
+  Rule::delete_rules(rules);
+}
+
+
+BOOST_AUTO_TEST_CASE(treenode_split) {
+  RuleVector rules;
+  grid_rules(64, rules);
+  TreeNode node(rules, make_tuple(0, rules.size() - 1));
+  node.split(0, 399);
+  BOOST_CHECK(node.has_been_cut());
+  BOOST_CHECK(node.is_split());
+  BOOST_CHECK_EQUAL(node.cut_dim(), 0);
+  BOOST_CHECK_EQUAL(node.cut_dims(), 1);
+  BOOST_REQUIRE_EQUAL(node.num_children(), 2);
+  BOOST_CHECK(node.child(0).box().box_bounds()[0] == make_tuple(0, 399));
+  BOOST_CHECK(node.child(1).box().box_bounds()[0]
+      == make_tuple(400, std::get<1>(node.box().box_bounds()[0])));
+  BOOST_CHECK_EQUAL(node.child(0).num_rules(), 32);
+  BOOST_CHECK_EQUAL(node.child(1).num_rules(), 32);
+  BOOST_CHECK_EQUAL(node.space_measure(), 66);
+  node.reset_cut();
+  BOOST_CHECK(!node.is_split());
+  node.cut(0, 1);
+  BOOST_CHECK(!node.is_split());
+  Rule::delete_rules(rules);
+}
+
+
+BOOST_AUTO_TEST_CASE(treenode_best_split) {
+  RuleVector rules;
+  grid_rules(64, rules);
+  TreeNode node(rules, make_tuple(0, rules.size() - 1));
+  size_t dimension = 42;
+  dim_t point = 42;
+  // both port dimensions halve the grid, the first one wins
+  BOOST_REQUIRE(node.best_split(dimension, point));
+  BOOST_CHECK_EQUAL(dimension, 0);
+  BOOST_CHECK_EQUAL(point, 399);
+  Rule::delete_rules(rules);
+  // a rule that covers the whole box leaves nothing to split
+  rules.clear();
+  rules.push_back(parse::parse_rule("-A bla -p tcp -j DROP"));
+  TreeNode wildcard(rules, make_tuple(0, 0));
+  BOOST_CHECK(!wildcard.best_split(dimension, point));
+  Rule::delete_rules(rules);
+}
+
+
+BOOST_AUTO_TEST_CASE(treenode_build_tree_hypersplit) {
+  RuleVector rules;
+  grid_rules(64, rules);
+  // every inner node splits one dimension in two
+  check_built_tree(rules, Arguments::DIM_CHOICE_MAX_DISTINCT,
+      Arguments::CUT_ALGO_HYPERSPLIT, false,
+      [] (TreeNode& node, const size_t) {
+    BOOST_CHECK_EQUAL(node.num_children(), 2);
+    BOOST_CHECK_EQUAL(__builtin_popcount(node.cut_dims()), 1);
+  });
+  Rule::delete_rules(rules);
+}
+
+
+#define NODE_WITH_COMMON_RULES                                                 \
+  RuleVector rules;                                                            \
+  rules.push_back(parse::parse_rule("-A CHAIN -p tcp --dport 443 -j DROP"));   \
+  rules.push_back(parse::parse_rule("-A CHAIN -p tcp --sport 0:9 -j ACCEPT")); \
+  rules.push_back(                                                             \
+      parse::parse_rule("-A CHAIN -p tcp --sport 9:19 -j ACCEPT"));            \
+  rules.push_back(parse::parse_rule("-A CHAIN -p tcp --dport 22 -j DROP"));    \
+  rules.push_back(parse::parse_rule("-A CHAIN -p tcp --dport 80 -j ACCEPT"));  \
+  TreeNode node(rules, make_tuple(0, rules.size() - 1));                       \
+  std::vector<PositionVector> positions;                                       \
+  node.cut(0, 1, &positions);                                                  \
+  node.push_common_rules(positions);
+
+
+BOOST_AUTO_TEST_CASE(treenode_push_common_rules) {
+  NODE_WITH_COMMON_RULES;
+  // the DROP for port 22 stays in the children behind the overlapping
+  // ACCEPTs, while the rules for ports 443 and 80 may be matched first
+  BOOST_REQUIRE_EQUAL(node.pushed_rule_ids().size(), 2);
+  BOOST_CHECK_EQUAL(node.pushed_rule_ids()[0], 0);
+  BOOST_CHECK_EQUAL(node.pushed_rule_ids()[1], 4);
+  BOOST_CHECK(node.pushed_rules()[1] == rules[4]);
+  BOOST_REQUIRE_EQUAL(node.num_children(), 2);
+  BOOST_CHECK_EQUAL(node.child(0).num_rules(), 3);
+  BOOST_CHECK(node.child(0).rules()[2] == rules[3]);
+  BOOST_CHECK_EQUAL(node.child(1).num_rules(), 1);
+  BOOST_CHECK(node.child(1).rules()[0] == rules[3]);
+  BOOST_REQUIRE_EQUAL(positions.size(), 2);
+  BOOST_CHECK(positions[0] == PositionVector({1, 2, 3}));
+  BOOST_CHECK(positions[1] == PositionVector({3}));
+  Rule::delete_rules(rules);
+}
+
+
+BOOST_AUTO_TEST_CASE(treenode_compact_child_regions) {
+  RuleVector rules;
+  rules.push_back(parse::parse_rule(
+      "-A CHAIN -p tcp --sport 0:9 --dport 5:6 -j DROP"));
+  rules.push_back(parse::parse_rule("-A CHAIN -p tcp --sport 40:49 -j DROP"));
+  TreeNode node(rules, make_tuple(0, rules.size() - 1));
+  node.cut(0, 1);
+  BOOST_REQUIRE_EQUAL(node.num_children(), 2);
+  node.compact_child_regions();
+  const DimVector& first = node.child(0).box().box_bounds();
+  const DimVector& second = node.child(1).box().box_bounds();
+  BOOST_CHECK(first[0] == make_tuple(0, 9));
+  BOOST_CHECK(first[1] == make_tuple(5, 6));
+  BOOST_CHECK(second[0] == make_tuple(40, 49));
+  BOOST_CHECK(second[1] == node.box().box_bounds()[1]);
+
+  // the cells of a hyper cut keep their slices in the cut dimensions
+  node.reset_cut();
+  std::vector<size_t> dims;
+  dims.push_back(0);
+  dims.push_back(1);
+  node.hyper_cut(dims, std::vector<size_t>(2, 1));
+  BOOST_REQUIRE_EQUAL(node.num_children(), 3);
+  const Box cell(node.child(0).box());
+  node.compact_child_regions();
+  BOOST_CHECK(node.child(0).box() == cell);
+  Rule::delete_rules(rules);
+}
+
+
+BOOST_AUTO_TEST_CASE(treenode_build_tree_compact_regions) {
+  RuleVector rules;
+  grid_rules(256, rules, 1000);
+  // every child's box lies within the hull of its rules, and outside the cut
+  // dimensions it is that hull clipped to its parent's box; inside the cut
+  // dimension, shrunk slices leave gaps between neighbouring children
+  size_t num_gaps = 0;
+  check_built_tree(rules, Arguments::DIM_CHOICE_MAX_DISTINCT,
+      Arguments::CUT_ALGO_EQUIDISTANT, true,
+      [&num_gaps] (TreeNode& node, const size_t) {
+    const DimVector& parent = node.box().box_bounds();
+    const TreeNode* previous = nullptr;
+    for (size_t i = 0; i < node.num_children(); ++i) {
+      const TreeNode& child = node.child(i);
+      const std::vector<const Rule*> child_rules(child.rules());
+      if (child_rules.empty())
+        continue;
+      const DimVector& bounds = child.box().box_bounds();
+      for (size_t dim = 0; dim < bounds.size(); ++dim) {
+        dim_t start = get<0>(child_rules[0]->box().box_bounds()[dim]);
+        dim_t end = get<1>(child_rules[0]->box().box_bounds()[dim]);
+        for (size_t k = 1; k < child_rules.size(); ++k) {
+          start = min(start, get<0>(child_rules[k]->box().box_bounds()[dim]));
+          end = max(end, get<1>(child_rules[k]->box().box_bounds()[dim]));
+        }
+        BOOST_CHECK(get<0>(bounds[dim]) >= max(start, get<0>(parent[dim])));
+        BOOST_CHECK(get<1>(bounds[dim]) <= min(end, get<1>(parent[dim])));
+        if ((node.cut_dims() >> dim) & 1)
+          continue;
+        BOOST_CHECK_EQUAL(get<0>(bounds[dim]), max(start, get<0>(parent[dim])));
+        BOOST_CHECK_EQUAL(get<1>(bounds[dim]), min(end, get<1>(parent[dim])));
+      }
+      const size_t dim = node.cut_dim();
+      if (previous != nullptr && get<1>(previous->box().box_bounds()[dim]) + 1
+          < get<0>(bounds[dim]))
+        ++num_gaps;
+      previous = &child;
+    }
+  });
+  BOOST_CHECK(num_gaps > 0);
+  Rule::delete_rules(rules);
+}
+
+
+BOOST_AUTO_TEST_CASE(treenode_build_tree_cost) {
+  RuleVector rules;
+  grid_rules(256, rules);
+  // no candidate cut that makes progress is expected to be cheaper than the
+  // chosen one
+  const TreeNode root(rules, make_tuple(0, 255));
+  size_t num_cuts;
+  const size_t dim = root.least_cost_cut(4, 4, num_cuts);
+  BOOST_REQUIRE(num_cuts > 0);
+  const double least_cost = CutEvaluator(root.box(), root.rule_table(),
+      root.rule_ids(), dim).expected_evaluations(num_cuts, 4);
+  for (size_t d = 0; d < root.box().num_dims(); ++d) {
+    const CutEvaluator evaluator(root.box(), root.rule_table(),
+        root.rule_ids(), d);
+    const size_t max_cuts = root.determine_number_of_cuts(d, 4);
+    for (size_t cuts = 1; cuts <= max_cuts; cuts = 2 * cuts + 1)
+      if (evaluator.max_rules_per_child(cuts) < root.num_rules())
+        BOOST_CHECK(evaluator.expected_evaluations(cuts, 4) >= least_cost);
+  }
+  // the tree is cut there
+  check_built_tree(rules, Arguments::DIM_CHOICE_COST,
+      Arguments::CUT_ALGO_EQUIDISTANT, false,
+      [dim] (TreeNode& node, const size_t depth) {
+    if (depth == 0)
+      BOOST_CHECK_EQUAL(node.cut_dim(), dim);
+  });
+  Rule::delete_rules(rules);
+}
+
+
+BOOST_AUTO_TEST_CASE(treenode_rule_orders) {
+  SINGLE_DIM_NODE_WITH_THREE_RULES;
+  RuleTable table;
+  RuleIdVector ids;
+  ids.push_back(table.add(&rule3));
+  ids.push_back(table.add(&rule1));
+  ids.push_back(table.add(&rule2));
+  const RuleOrders orders(table, ids, 1);
+  BOOST_REQUIRE_EQUAL(orders.by_start(0).size(), 3);
+  BOOST_CHECK_EQUAL(orders.by_start(0)[0], 1);
+  BOOST_CHECK_EQUAL(orders.by_start(0)[1], 2);
+  BOOST_CHECK_EQUAL(orders.by_start(0)[2], 0);
+  BOOST_CHECK(orders.by_end(0) == orders.by_start(0));
+  std::vector<DimTuple> intervals;
+  orders.sorted_intervals(0, table, ids, intervals);
+  BOOST_REQUIRE_EQUAL(intervals.size(), 3);
+  BOOST_CHECK(intervals[0] == rule1_bounds[0]);
+  BOOST_CHECK(intervals[1] == rule2_bounds[0]);
+  BOOST_CHECK(intervals[2] == rule3_bounds[0]);
+  BOOST_CHECK_EQUAL(node.num_rules(), 3);
+}
+
+
+BOOST_AUTO_TEST_CASE(treenode_rule_orders_derive) {
+  RuleVector rules;
+  grid_rules(64, rules);
+  DomainTuple domain(make_tuple(0, 63));
+  TreeNode node(rules, domain);
+  const size_t num_dims = node.box().num_dims();
+  const RuleOrders orders(node.rule_table(), node.rule_ids(), num_dims);
+  std::vector<PositionVector> child_positions;
+  node.cut(1, 3, &child_positions);
+  const size_t num_children = node.num_children();
+  BOOST_REQUIRE_EQUAL(child_positions.size(), num_children);
+  std::vector<RuleOrders> derived(num_children, RuleOrders(num_dims));
+  std::vector<RuleOrders*> child_orders;
+  for (size_t i = 0; i < num_children; ++i)
+    child_orders.push_back(&derived[i]);
+  orders.derive(child_positions, child_orders);
+  for (size_t i = 0; i < num_children; ++i) {
+    // deriving must give the same orderings as sorting the child's rules
+    const RuleOrders expected(node.rule_table(), node.child(i).rule_ids(),
+        num_dims);
+    for (size_t dim = 0; dim < num_dims; ++dim) {
+      BOOST_CHECK(derived[i].by_start(dim) == expected.by_start(dim));
+      BOOST_CHECK(derived[i].by_end(dim) == expected.by_end(dim));
+    }
+  }
+  Rule::delete_rules(rules);
+}
+
+/*****************************************************************************
+ *                      C U T E V A L   T E S T S                            *
+ *****************************************************************************/
+
+BOOST_AUTO_TEST_CASE(cuteval_child_rule_counts) {
+  SINGLE_DIM_NODE_WITH_THREE_RULES;
+  const CutEvaluator evaluator(node.box(), node.rule_table(),
+      node.rule_ids(), 0);
+  std::vector<size_t> counts;
+  evaluator.child_rule_counts(1, counts);
+  BOOST_REQUIRE_EQUAL(counts.size(), 2);
+  BOOST_CHECK_EQUAL(counts[0], 2);
+  BOOST_CHECK_EQUAL(counts[1], 2);
+  // more cuts than points in the interval
+  evaluator.child_rule_counts(20, counts);
+  BOOST_REQUIRE_EQUAL(counts.size(), 21);
+  BOOST_CHECK_EQUAL(counts[0], 0);
+  for (size_t i = 1; i <= 10; ++i)
+    BOOST_CHECK_EQUAL(counts[i], 1);
+  for (size_t i = 11; i <= 20; ++i)
+    BOOST_CHECK_EQUAL(counts[i], 0);
+  BOOST_CHECK_EQUAL(evaluator.space_measure(1), 6);
+  BOOST_CHECK_EQUAL(evaluator.max_rules_per_child(1), 2);
+  BOOST_CHECK_EQUAL(evaluator.num_common_rules(1), 1);
+  BOOST_CHECK_EQUAL(evaluator.num_common_rules(3), 0);
+  BOOST_CHECK_EQUAL(evaluator.num_common_rules(20), 0);
+}
+
+
+BOOST_AUTO_TEST_CASE(cuteval_dispatch_evaluations) {
+  BOOST_CHECK_CLOSE(CutEvaluator::dispatch_evaluations(1), 1, 1e-9);
+  BOOST_CHECK_CLOSE(CutEvaluator::dispatch_evaluations(2), 2, 1e-9);
+  BOOST_CHECK_CLOSE(CutEvaluator::dispatch_evaluations(5), 7, 1e-9);
+}
+
+
+BOOST_AUTO_TEST_CASE(cuteval_expected_evaluations) {
+  SINGLE_DIM_NODE_WITH_THREE_RULES;
+  const CutEvaluator evaluator(node.box(), node.rule_table(),
+      node.rule_ids(), 0);
+  // the common rule plus two leaves of one rule, each scanned up to the
+  // fall-through jump
+  BOOST_CHECK_CLOSE(evaluator.expected_evaluations(1, 4), 5, 1e-9);
+  // the second rule is common to both children and pushed up
+  BOOST_CHECK_CLOSE(evaluator.expected_evaluations(1, 1), 5, 1e-9);
+  // four children of 1, 2, 2 and 1 rules behind a two level search
+  BOOST_CHECK_CLOSE(evaluator.expected_evaluations(3, 4), 7.5, 1e-9);
+}
+
+
+BOOST_AUTO_TEST_CASE(cuteval_set_packets) {
+  SINGLE_DIM_NODE_WITH_THREE_RULES;
+  CutEvaluator evaluator(node.box(), node.rule_table(), node.rule_ids(), 0);
+  PacketSet packets;
+  const dim_t point[PacketSet::NUM_DIMS] = {7, 0, 0, 0};
+  packets.add(point, 3);
+  evaluator.set_packets(packets);
+  // all packets land in the third child of two rules
+  BOOST_CHECK_CLOSE(evaluator.expected_evaluations(3, 4), 8, 1e-9);
+}
+
+
+BOOST_AUTO_TEST_CASE(cuteval_matches_cut) {
+  RuleVector rules;
+  grid_rules(64, rules);
+  DomainTuple domain(make_tuple(0, 63));
+  TreeNode node(rules, domain);
+  const size_t num_cuts[4] = {1, 3, 7, 20};
+  std::vector<size_t> counts;
+  for (size_t dim = 0; dim < node.box().num_dims(); ++dim) {
+    const CutEvaluator evaluator(node.box(), node.rule_table(),
+        node.rule_ids(), dim);
+    for (size_t i = 0; i < 4; ++i) {
+      node.reset_cut();
+      node.cut(dim, num_cuts[i]);
+      evaluator.child_rule_counts(num_cuts[i], counts);
+      DimVector slices;
+      node.box().cut_slices(dim, num_cuts[i], slices);
+      // the cut leaves out empty children and lets neighbouring slices with
+      // the same rules share one child
+      size_t j = 0;
+      for (size_t k = 0; k < counts.size(); ++k) {
+        if (counts[k] == 0)
+          continue;
+        if (j > 0 && std::get<0>(slices[k])
+            <= std::get<1>(node.child(j - 1).box().box_bounds()[dim])) {
+          BOOST_CHECK_EQUAL(counts[k], node.child(j - 1).num_rules());
+          continue;
+        }
+        BOOST_REQUIRE(j < node.num_children());
+        BOOST_CHECK_EQUAL(counts[k], node.child(j).num_rules());
+        ++j;
+      }
+      BOOST_CHECK_EQUAL(j, node.num_children());
+      // shared children are counted once by the node only
+      BOOST_CHECK(evaluator.space_measure(num_cuts[i])
+          >= node.space_measure());
+    }
+  }
+  Rule::delete_rules(rules);
+}
+
+/*****************************************************************************
+ *                    R U L E T A B L E   T E S T S                          *
+ *****************************************************************************/
+
+BOOST_AUTO_TEST_CASE(ruletable_add) {
+  RuleVector rules;
+  rules.push_back(parse::parse_rule("-A INPUT --src 10.0.0.0/8 -p tcp "
+      "--sport 80 --dport 1000:2000 -j DROP"));
+  DimVector bounds;
+  bounds.push_back(make_tuple(3, 7));
+  rules.push_back(new Rule(DROP, Box(bounds), ""));
+  RuleTable table;
+  BOOST_CHECK_EQUAL(table.add(rules[0]), 0);
+  BOOST_CHECK_EQUAL(table.add(rules[1]), 1);
+  BOOST_CHECK_EQUAL(table.size(), 2);
+  BOOST_CHECK_EQUAL(table.rule(1), rules[1]);
+  for (size_t dim = 0; dim < RuleTable::NUM_DIMS; ++dim) {
+    const DimTuple& interval = rules[0]->box().box_bounds()[dim];
+    BOOST_CHECK_EQUAL(table.start(dim, 0), std::get<0>(interval));
+    BOOST_CHECK_EQUAL(table.end(dim, 0), std::get<1>(interval));
+  }
+  // missing dimensions span their whole range
+  BOOST_CHECK_EQUAL(table.start(0, 1), 3);
+  BOOST_CHECK_EQUAL(table.end(0, 1), 7);
+  BOOST_CHECK_EQUAL(table.start(1, 1), min_port);
+  BOOST_CHECK_EQUAL(table.end(1, 1), max_port);
+  BOOST_CHECK_EQUAL(table.start(3, 1), min_ip);
+  BOOST_CHECK_EQUAL(table.end(3, 1), max_ip);
+  // port dimensions take 16 bits only
+  DimVector wide_bounds;
+  wide_bounds.push_back(make_tuple(0, max_port + 1));
+  Rule wide_rule(DROP, Box(wide_bounds), "");
+  BOOST_CHECK_THROW(table.add(&wide_rule), std::string);
+  Rule::delete_rules(rules);
+}
+
+
+BOOST_AUTO_TEST_CASE(ruletable_matches_box_and_rule) {
+  RuleVector rules;
+  grid_rules(64, rules);
+  RuleTable table;
+  for (size_t i = 0; i < rules.size(); ++i)
+    table.add(rules[i]);
+  DimVector frame_bounds(rules[0]->box().box_bounds());
+  frame_bounds[0] = make_tuple(50, 349);
+  frame_bounds[1] = make_tuple(15, 44);
+  const Box frame(frame_bounds);
+  const TableBox table_frame(frame);
+  for (size_t i = 0; i < rules.size(); ++i) {
+    BOOST_CHECK_EQUAL(table.collide(i, table_frame),
+        rules[i]->box().collide(frame));
+    for (size_t j = 0; j < rules.size(); ++j)
+      BOOST_CHECK_EQUAL(table.is_shadowed(i, j, table_frame),
+          rules[i]->is_shadowed(rules[j], frame));
+  }
+  Rule::delete_rules(rules);
+}
+
+/*****************************************************************************
+ *                       C O L L I D E   T E S T S                           *
+ *****************************************************************************/
+
+BOOST_AUTO_TEST_CASE(collide_kernels_match_table) {
+  std::minstd_rand rng(7);
+  RuleVector rules;
+  for (size_t i = 0; i < 150; ++i) {
+    DimVector bounds;
+    for (size_t dim = 0; dim < RuleTable::NUM_DIMS; ++dim) {
+      const dim_t limit = dim < RuleTable::NUM_PORT_DIMS ? max_port : max_ip;
+      const dim_t start = rng() % (limit / 2);
+      bounds.push_back(make_tuple(start, start + rng() % (limit / 2)));
+    }
+    rules.push_back(new Rule(DROP, Box(bounds), ""));
+  }
+  RuleTable table;
+  RuleIdVector ids;
+  for (size_t i = 0; i < rules.size(); ++i)
+    ids.push_back(table.add(rules[i]));
+  const CollisionBlock block(table, ids);
+  BOOST_CHECK_EQUAL(block.num_words(), 3);
+  BOOST_CHECK(CollisionBlock::supports(CollisionBlock::best_kernel()));
+  const size_t kernels[3] = {CollisionBlock::KERNEL_SCALAR,
+                             CollisionBlock::KERNEL_SSE4,
+                             CollisionBlock::KERNEL_AVX2};
+  std::vector<uint64_t> mask;
+  for (size_t n = 0; n < 20; ++n) {
+    DimVector box_bounds;
+    for (size_t dim = 0; dim < RuleTable::NUM_DIMS; ++dim) {
+      const dim_t limit = dim < RuleTable::NUM_PORT_DIMS ? max_port : max_ip;
+      const dim_t start = rng() % limit;
+      box_bounds.push_back(make_tuple(start, start + rng() % (limit - start)));
+    }
+    // the last box spans everything and collides with all rules
+    if (n == 19)
+      for (size_t dim = 0; dim < RuleTable::NUM_DIMS; ++dim)
+        box_bounds[dim] = make_tuple(0, max_ip);
+    const TableBox box((Box(box_bounds)));
+    for (size_t k = 0; k < 3; ++k) {
+      if (!CollisionBlock::supports(kernels[k]))
+        continue;
+      block.collide(box, mask, kernels[k]);
+      BOOST_REQUIRE_EQUAL(mask.size(), 3);
+      for (size_t i = 0; i < 3 * 64; ++i) {
+        const bool bit = (mask[i / 64] >> (i % 64)) & 1;
+        BOOST_CHECK_EQUAL(bit, i < ids.size() && table.collide(ids[i], box));
+      }
+    }
+  }
+  Rule::delete_rules(rules);
+}
+
+/*****************************************************************************
+ *                        S H A D O W   T E S T S                            *
+ *****************************************************************************/
+
+BOOST_AUTO_TEST_CASE(shadow_index_shadowed) {
+  DimVector frame_bounds;
+  frame_bounds.push_back(make_tuple(10, 20));
+  frame_bounds.push_back(make_tuple(10, 20));
+  const Box frame(frame_bounds);
+  DimVector bounds1;
+  bounds1.push_back(make_tuple(0, 15));
+  bounds1.push_back(make_tuple(5, 30));
+  Rule rule1(DROP, Box(bounds1), "");
+  DimVector bounds2;
+  bounds2.push_back(make_tuple(12, 14));
+  bounds2.push_back(make_tuple(0, 100));
+  Rule rule2(DROP, Box(bounds2), "");
+  DimVector bounds3;
+  bounds3.push_back(make_tuple(14, 16));
+  bounds3.push_back(make_tuple(11, 12));
+  Rule rule3(DROP, Box(bounds3), "");
+  RuleTable table;
+  const uint32_t id1 = table.add(&rule1);
+  const uint32_t id2 = table.add(&rule2);
+  const uint32_t id3 = table.add(&rule3);
+  ShadowIndex index(table, TableBox(frame));
+  BOOST_CHECK(!index.shadowed(id2));
+  index.insert(id1);
+  BOOST_CHECK_EQUAL(index.size(), 1);
+  // the second rule is wider than the first one, but not within the frame
+  BOOST_CHECK(index.shadowed(id2));
+  BOOST_CHECK(!index.shadowed(id3));
+}
+
+
+BOOST_AUTO_TEST_CASE(shadow_index_matches_is_shadowed) {
+  DimVector frame_bounds;
+  frame_bounds.push_back(make_tuple(8, 56));
+  frame_bounds.push_back(make_tuple(0, 63));
+  frame_bounds.push_back(make_tuple(16, 40));
+  const Box frame(frame_bounds);
+  std::minstd_rand rng(42);
+  RuleVector rules;
+  for (size_t i = 0; i < 500; ++i) {
+    DimVector bounds;
+    for (size_t dim = 0; dim < 3; ++dim) {
+      const dim_t start = rng() % 64;
+      bounds.push_back(make_tuple(start, start + rng() % (64 - start)));
+    }
+    rules.push_back(new Rule(DROP, Box(bounds), ""));
+  }
+  RuleTable table;
+  for (size_t i = 0; i < rules.size(); ++i)
+    table.add(rules[i]);
+  ShadowIndex index(table, TableBox(frame));
+  std::vector<const Rule*> kept;
+  for (size_t i = 0; i < rules.size(); ++i) {
+    bool shadowed = false;
+    for (size_t j = 0; j < kept.size() && !shadowed; ++j)
+      shadowed = rules[i]->is_shadowed(kept[j], frame);
+    BOOST_CHECK_EQUAL(index.shadowed(i), shadowed);
+    if (!shadowed) {
+      index.insert(i);
+      kept.push_back(rules[i]);
+    }
+  }
+  BOOST_CHECK(kept.size() > 32);
+  // the node switches to the index on the way and must keep the same rules
+  TreeNode node(frame);
+  for (size_t i = 0; i < rules.size(); ++i)
+    node.add_rule(rules[i]);
+  BOOST_CHECK(node.rules() == kept);
+  Rule::delete_rules(rules);
+}
+
+
+BOOST_AUTO_TEST_CASE(shadow_index_matches_collide) {
+  const Box frame((DimVector()));
+  std::minstd_rand rng(42);
+  RuleVector rules;
+  for (size_t i = 0; i < 500; ++i) {
+    DimVector bounds;
+    for (size_t dim = 0; dim < 3; ++dim) {
+      const dim_t start = rng() % 256;
+      bounds.push_back(make_tuple(start, start + rng() % 16));
+    }
+    rules.push_back(new Rule(DROP, Box(bounds), ""));
+  }
+  RuleTable table;
+  for (size_t i = 0; i < rules.size(); ++i)
+    table.add(rules[i]);
+  ShadowIndex index(table, TableBox(frame));
+  size_t num_collisions = 0;
+  for (size_t i = 0; i < rules.size(); ++i) {
+    bool collides = false;
+    for (size_t j = 0; j < i && !collides; j += 2)
+      collides = rules[i]->box().collide(rules[j]->box());
+    BOOST_CHECK_EQUAL(index.collides(i), collides);
+    num_collisions += collides;
+    // every other rule is inserted
+    if (i % 2 == 0)
+      index.insert(i);
+  }
+  BOOST_CHECK(num_collisions > 0 && num_collisions < rules.size() / 2);
+  Rule::delete_rules(rules);
+}
+
+/*****************************************************************************
+ *                       R U L E S E T   T E S T S                           *
+ *****************************************************************************/
+
+BOOST_AUTO_TEST_CASE(ruleset_compact) {
+  RuleSet sparse;
+  RuleSet dense;
+  for (uint32_t id = 3; id < 200; id += 3) {
+    sparse.push_back(id);
+    dense.push_back(id);
+  }
+  // 66 ids up to 198 need more memory as a list than as a bitset
+  dense.compact(256);
+  BOOST_CHECK(dense.dense());
+  BOOST_CHECK_EQUAL(dense.size(), sparse.size());
+  BOOST_CHECK(dense == sparse);
+  BOOST_CHECK_EQUAL(dense.intersection_size(sparse), sparse.size());
+  for (uint32_t id = 0; id < 256; ++id)
+    BOOST_CHECK_EQUAL(dense.contains(id), id % 3 == 0 && id > 0 && id < 200);
+  for (size_t i = 0; i < sparse.size(); ++i)
+    BOOST_CHECK_EQUAL(dense.at(i), sparse.at(i));
+  RuleIdVector ids;
+  dense.collect(ids);
+  BOOST_CHECK(ids == sparse.ids());
+  // the raw bitset words are not handed out as ids
+  BOOST_CHECK_THROW(dense.ids(), std::string);
+  // a bitset up to a single large id would be larger than the list
+  RuleSet few;
+  few.push_back(1000);
+  few.compact(2000);
+  BOOST_CHECK(!few.dense());
+  BOOST_CHECK(few != sparse);
+  dense.push_back(300);
+  BOOST_CHECK(!dense.dense());
+  BOOST_CHECK_EQUAL(dense.size(), sparse.size() + 1);
+  BOOST_CHECK_EQUAL(dense.ids().back(), 300);
+}
+
+
+BOOST_AUTO_TEST_CASE(ruleset_hash) {
+  RuleSet sparse;
+  RuleSet dense;
+  RuleSet other;
+  for (uint32_t id = 1; id < 100; id += 2) {
+    sparse.push_back(id);
+    dense.push_back(id);
+    other.push_back(id + 1);
+  }
+  dense.compact(100);
+  BOOST_REQUIRE(dense.dense());
+  BOOST_CHECK_EQUAL(sparse.hash(), dense.hash());
+  BOOST_CHECK(sparse.hash() != other.hash());
+  BOOST_CHECK_EQUAL(RuleSet().hash(), RuleSet().hash());
+}
+
+
+BOOST_AUTO_TEST_CASE(ruleset_compacted_tree) {
+  RuleVector rules;
+  grid_rules(64, rules);
+  TreeNode tree(rules, make_tuple(0, rules.size() - 1));
+  tree.build_tree(2, 4, Arguments::DIM_CHOICE_MAX_DISTINCT,
+      Arguments::CUT_ALGO_EQUIDISTANT);
+  BOOST_CHECK(tree.rule_set().dense());
+  // every node keeps its rules in the same order as its box collides with
+  // them
+  NodeRefStack stack;
+  stack.push(&tree);
+  while (!stack.empty()) {
+    TreeNode* node = stack.top();
+    stack.pop();
+    std::vector<const Rule*> expected;
+    for (size_t i = 0; i < rules.size(); ++i)
+      if (rules[i]->box().collide(node->box()))
+        expected.push_back(rules[i]);
+    const std::vector<const Rule*> actual(node->rules());
+    BOOST_CHECK(actual.size() <= expected.size());
+    for (size_t i = 0; i < actual.size(); ++i) {
+      BOOST_CHECK(std::find(expected.begin(), expected.end(), actual[i])
+          != expected.end());
+      BOOST_CHECK_EQUAL(node->rule(i), actual[i]);
+    }
+    for (size_t i = 0; i < node->num_children(); ++i)
+      stack.push(&node->child(i));
+  }
+  Rule::delete_rules(rules);
+}
+
 /*****************************************************************************
  *                         P A R S E   T E S T S                             *
  *****************************************************************************/
@@ -778,6 +1939,28 @@ BOOST_AUTO_TEST_CASE(parse_file_read_lines) {
 }
 
 
+BOOST_AUTO_TEST_CASE(parse_next_token) {
+  const string line("-A INPUT  -j");
+  size_t pos = 0;
+  StrView token;
+  BOOST_CHECK(parse::next_token(line, pos, token));
+  BOOST_CHECK(token == "-A");
+  BOOST_CHECK(token.data() == line.data());
+  BOOST_CHECK(parse::next_token(line, pos, token));
+  BOOST_CHECK(token == "INPUT");
+  BOOST_CHECK(parse::next_token(line, pos, token));
+  BOOST_CHECK(token == "");
+  BOOST_CHECK(parse::next_token(line, pos, token));
+  BOOST_CHECK(token == "-j");
+  BOOST_CHECK(!parse::next_token(line, pos, token));
+
+  pos = 0;
+  BOOST_CHECK(parse::next_token("", pos, token));
+  BOOST_CHECK(token.empty());
+  BOOST_CHECK(!parse::next_token("", pos, token));
+}
+
+
 BOOST_AUTO_TEST_CASE(parse_parse_ip) {
   BOOST_CHECK_EQUAL(parse::parse_ip("1.2.3.4"), 16909060);
   BOOST_CHECK_EQUAL(parse::parse_ip("0.00.000.0"), 0);
@@ -999,6 +2182,42 @@ BOOST_AUTO_TEST_CASE(parse_parse_rule) {
 }
 
 
+BOOST_AUTO_TEST_CASE(parse_parse_rule_option_keywords) {
+  Rule* rule = parse::parse_rule("-A INPUT -p tcp --src 1.2.3.0/24 "
+      "--dst-range 0.0.0.1-0.0.0.2 --sport 80 --dport 1:2 -j DROP");
+  BOOST_CHECK(rule->applicable());
+  const DimVector& bounds = rule->box().box_bounds();
+  BOOST_CHECK_EQUAL(get<0>(bounds[0]), 80);
+  BOOST_CHECK_EQUAL(get<1>(bounds[0]), 80);
+  BOOST_CHECK_EQUAL(get<0>(bounds[1]), 1);
+  BOOST_CHECK_EQUAL(get<1>(bounds[1]), 2);
+  BOOST_CHECK_EQUAL(get<0>(bounds[2]), parse::parse_ip("1.2.3.0"));
+  BOOST_CHECK_EQUAL(get<1>(bounds[2]), parse::parse_ip("1.2.3.255"));
+  BOOST_CHECK_EQUAL(get<0>(bounds[3]), 1);
+  BOOST_CHECK_EQUAL(get<1>(bounds[3]), 2);
+  BOOST_CHECK(rule->action() == Action(DROP));
+  delete rule;
+
+  // words that only resemble options make the rule not applicable
+  const char* near_misses[] = {"-a", "--srx 1.2.3.4", "--sport:80",
+      "--src-rangee 1-2", "-AA"};
+  for (size_t i = 0; i < 5; ++i) {
+    rule = parse::parse_rule("-A INPUT -p tcp " + string(near_misses[i]));
+    BOOST_CHECK(!rule->applicable());
+    delete rule;
+  }
+
+  bool thrown = false;
+  try {
+    parse::parse_rule("-A INPUT -p tcp --dport");
+  } catch (const string& msg) {
+    BOOST_CHECK(msg == "Invalid --sport or --dport specification");
+    thrown = true;
+  }
+  BOOST_CHECK(thrown);
+}
+
+
 BOOST_AUTO_TEST_CASE(parse_parse_rule_not_applicable_with_chain) {
   Rule* rule = parse::parse_rule("-A CHAIN -p icmp -j DROP");
   BOOST_CHECK_EQUAL(rule->chain(), "CHAIN");
@@ -1116,6 +2335,91 @@ BOOST_AUTO_TEST_CASE(parse_parse_rules_with_meta_info) {
 }
 
 
+BOOST_AUTO_TEST_CASE(parse_parse_rules_views) {
+  const string text("*filter\n:INPUT DROP [0:0]\n"
+      "-A INPUT -p tcp --dport 22 -j ACCEPT\n-A c -j DROP\nCOMMIT\n");
+  ViewVector input;
+  size_t start = 0;
+  for (size_t i = 0; i < text.size(); ++i) {
+    if (text[i] == '\n') {
+      input.push_back(StrView(text.data() + start, i - start));
+      start = i + 1;
+    }
+  }
+  RuleVector rules;
+  DefaultPolicies policies;
+  parse::parse_rules(input, rules, policies);
+  BOOST_REQUIRE_EQUAL(rules.size(), 2);
+  BOOST_CHECK(rules[0]->applicable());
+  BOOST_CHECK(rules[0]->src() == "-A INPUT -p tcp --dport 22 -j ACCEPT");
+  BOOST_CHECK(rules[1]->chain() == "c");
+  BOOST_CHECK_EQUAL(policies.input_policy(), DROP);
+  Rule::delete_rules(rules);
+}
+
+
+BOOST_AUTO_TEST_CASE(parse_parse_rules_jobs) {
+  StrVector lines;
+  lines.push_back("*filter");
+  lines.push_back(":INPUT ACCEPT [0:0]");
+  for (size_t i = 0; i < 100; ++i) {
+    stringstream ss;
+    ss << "-A INPUT -p tcp --dport " << i << " -j DROP";
+    lines.push_back(ss.str());
+    if (i == 50)
+      lines.push_back(":INPUT DROP [0:0]");
+  }
+  lines.push_back("COMMIT");
+  const ViewVector input(lines.begin(), lines.end());
+
+  RuleVector rules;
+  DefaultPolicies policies;
+  parse::parse_rules(input, rules, policies, 3);
+  BOOST_REQUIRE_EQUAL(rules.size(), 100);
+  for (size_t i = 0; i < 100; ++i)
+    BOOST_CHECK_EQUAL(get<0>(rules[i]->box().box_bounds()[1]), i);
+  BOOST_CHECK_EQUAL(policies.input_policy(), DROP);
+  Rule::delete_rules(rules);
+  rules.clear();
+
+  // the error of the earliest faulty line is reported
+  lines[30] = "-A INPUT -p tcp --dport 70000 -j DROP";
+  lines[90] = "-A INPUT -p tcp --dport";
+  const ViewVector faulty(lines.begin(), lines.end());
+  bool thrown = false;
+  try {
+    parse::parse_rules(faulty, rules, policies, 3);
+  } catch (const string& msg) {
+    BOOST_CHECK(msg == "Invalid port: '70000'");
+    thrown = true;
+  }
+  BOOST_CHECK(thrown);
+  BOOST_CHECK_EQUAL(rules.size(), 28);
+  Rule::delete_rules(rules);
+  rules.clear();
+
+  // a faulty policy line ends the input just like a faulty rule
+  lines[30] = ":FORWARD BOGUS [0:0]";
+  const ViewVector faulty_policy(lines.begin(), lines.end());
+  for (size_t jobs = 1; jobs <= 3; jobs += 2) {
+    DefaultPolicies partial;
+    thrown = false;
+    try {
+      parse::parse_rules(faulty_policy, rules, partial, jobs);
+    } catch (const string& msg) {
+      BOOST_CHECK(msg == "Default policy code 'BOGUS' not understood!");
+      thrown = true;
+    }
+    BOOST_CHECK(thrown);
+    BOOST_REQUIRE_EQUAL(rules.size(), 28);
+    BOOST_CHECK_EQUAL(get<0>(rules[27]->box().box_bounds()[1]), 27);
+    BOOST_CHECK_EQUAL(partial.input_policy(), ACCEPT);
+    Rule::delete_rules(rules);
+    rules.clear();
+  }
+}
+
+
 BOOST_AUTO_TEST_CASE(parse_compute_relevant_sub_rulesets) {
   RuleVector rules;
   DomainVector domains;
@@ -1244,6 +2548,55 @@ BOOST_AUTO_TEST_CASE(parse_compute_relevant_sub_rulesets_with_sort) {
   Rule::delete_rules(rules);
 }
 
+
+BOOST_AUTO_TEST_CASE(parse_large_fields) {
+  Rule* wildcard = parse::parse_rule("-A c -p tcp -j DROP");
+  Rule* net8 = parse::parse_rule(
+      "-A c -p tcp --sport 1:255 --dport 1:256 --src 10.0.0.0/8 "
+      "--dst 10.0.0.0/9 -j DROP");
+  BOOST_CHECK_EQUAL(parse::large_fields(wildcard), 15);
+  BOOST_CHECK_EQUAL(parse::large_fields(net8), 6);
+  delete wildcard;
+  delete net8;
+}
+
+
+BOOST_AUTO_TEST_CASE(parse_separate_large_field_rules) {
+  RuleVector rules;
+  rules.push_back(parse::parse_rule("-A CHAIN -p tcp --dport 80 -j ACCEPT"));
+  rules.push_back(parse::parse_rule("-A c -p tcp -j DROP"));
+  rules.push_back(parse::parse_rule("-A c -p tcp --dport 22 -j ACCEPT"));
+  rules.push_back(parse::parse_rule("-A c -p tcp --sport 5 --dport 5 -j DROP"));
+  const RuleVector original(rules);
+  DomainVector domains;
+  domains.push_back(make_tuple(0, 3));
+  parse::separate_large_field_rules(rules, 1, domains);
+  // the last rule moves to the front, while the ACCEPT for port 22 stays
+  // behind the overlapping DROP
+  BOOST_REQUIRE_EQUAL(domains.size(), 3);
+  BOOST_CHECK(domains[0] == make_tuple(0, 0));
+  BOOST_CHECK(domains[1] == make_tuple(1, 1));
+  BOOST_CHECK(domains[2] == make_tuple(2, 3));
+  BOOST_CHECK(rules[0] == original[3]);
+  BOOST_CHECK(rules[1] == original[0]);
+  BOOST_CHECK(rules[2] == original[1]);
+  BOOST_CHECK(rules[3] == original[2]);
+
+  // small categories are merged
+  rules = original;
+  domains.assign(1, make_tuple(0, 3));
+  parse::separate_large_field_rules(rules, 2, domains);
+  BOOST_REQUIRE_EQUAL(domains.size(), 2);
+  BOOST_CHECK(domains[0] == make_tuple(0, 1));
+  BOOST_CHECK(domains[1] == make_tuple(2, 3));
+  rules = original;
+  domains.assign(1, make_tuple(0, 3));
+  parse::separate_large_field_rules(rules, 3, domains);
+  BOOST_REQUIRE_EQUAL(domains.size(), 1);
+  BOOST_CHECK(domains[0] == make_tuple(0, 3));
+  Rule::delete_rules(rules);
+}
+
 /*****************************************************************************
  *                            A R G   T E S T S                              *
  *****************************************************************************/
@@ -1333,6 +2686,8 @@ BOOST_AUTO_TEST_CASE(arg_parse_dim_choice) {
   BOOST_CHECK_EQUAL(args.dim_choice(), Arguments::DIM_CHOICE_LEAST_MAX_RULES);
   args.parse_dim_choice("max-dist");
   BOOST_CHECK_EQUAL(args.dim_choice(), Arguments::DIM_CHOICE_MAX_DISTINCT);
+  args.parse_dim_choice("cost");
+  BOOST_CHECK_EQUAL(args.dim_choice(), Arguments::DIM_CHOICE_COST);
   
   bool thrown = false;
   try {
@@ -1340,7 +2695,7 @@ BOOST_AUTO_TEST_CASE(arg_parse_dim_choice) {
   } catch (const string& msg) {
     stringstream ss;
     ss << "Invalid parameter --dim-choice ('xxx'):";
-    ss << " must be 'max-dist' or 'least-max'!";
+    ss << " must be 'max-dist', 'least-max' or 'cost'!";
     BOOST_CHECK(msg == ss.str());
     thrown = true;
   }
@@ -1402,6 +2757,10 @@ BOOST_AUTO_TEST_CASE(arg_parse_cut_algo) {
   BOOST_CHECK_EQUAL(args.cut_algo(), Arguments::CUT_ALGO_EQUIDISTANT);
   args.parse_cut_algo("unequal");
   BOOST_CHECK_EQUAL(args.cut_algo(), Arguments::CUT_ALGO_UNEQUAL);
+  args.parse_cut_algo("hypercuts");
+  BOOST_CHECK_EQUAL(args.cut_algo(), Arguments::CUT_ALGO_HYPERCUTS);
+  args.parse_cut_algo("hypersplit");
+  BOOST_CHECK_EQUAL(args.cut_algo(), Arguments::CUT_ALGO_HYPERSPLIT);
   args.parse_cut_algo("equidistant");
   BOOST_CHECK_EQUAL(args.cut_algo(), Arguments::CUT_ALGO_EQUIDISTANT);
 
@@ -1418,7 +2777,8 @@ BOOST_AUTO_TEST_CASE(arg_parse_cut_algo) {
       thrown = true;
       stringstream ss;
       ss << "Invalid parameter --cut-algo ('" << fail << "'):";
-      ss << " must be 'equidistant' or 'unequal'!";
+      ss << " must be 'equidistant', 'unequal', 'hypercuts' or";
+      ss << " 'hypersplit'!";
       BOOST_CHECK(ss.str() == msg);
     }
     BOOST_CHECK(thrown);
@@ -1457,6 +2817,35 @@ BOOST_AUTO_TEST_CASE(arg_parse_random_seed) {
 }
 
 
+BOOST_AUTO_TEST_CASE(arg_parse_jobs) {
+  Arguments args;
+  BOOST_CHECK_EQUAL(args.jobs(), 1);
+  args.parse_jobs("8");
+  BOOST_CHECK_EQUAL(args.jobs(), 8);
+  args.parse_jobs("1024");
+  BOOST_CHECK_EQUAL(args.jobs(), 1024);
+
+  StrVector fails;
+  fails.push_back("0");
+  fails.push_back("1025");
+  fails.push_back("four");
+  for (size_t i = 0; i < fails.size(); ++i) {
+    const string& fail = fails[i];
+    bool thrown = false;
+    try {
+      args.parse_jobs(fail);
+    } catch (const string& msg) {
+      thrown = true;
+      stringstream ss;
+      ss << "Invalid parameter --jobs ('" << fail << "'):";
+      ss << " must be an integer between 1 and 1024!";
+      BOOST_CHECK_EQUAL(ss.str(), msg);
+    }
+    BOOST_CHECK(thrown);
+  }
+}
+
+
 BOOST_AUTO_TEST_CASE(arg_parse_arg_vector) {
   StrVector vector;
   vector.push_back("--binth");
@@ -1475,6 +2864,8 @@ BOOST_AUTO_TEST_CASE(arg_parse_arg_vector) {
   vector.push_back("3");
   vector.push_back("--cut-algo");
   vector.push_back("unequal");
+  vector.push_back("--jobs");
+  vector.push_back("4");
 
   Arguments a1(Arguments::parse_arg_vector(vector));
   BOOST_CHECK_EQUAL(a1.binth(), 5);
@@ -1485,6 +2876,7 @@ BOOST_AUTO_TEST_CASE(arg_parse_arg_vector) {
   BOOST_CHECK_EQUAL(a1.outfile(), "OUTFILE");
   BOOST_CHECK_EQUAL(a1.random_seed(), 3);
   BOOST_CHECK_EQUAL(a1.cut_algo(), Arguments::CUT_ALGO_UNEQUAL);
+  BOOST_CHECK_EQUAL(a1.jobs(), 4);
 
   vector.clear();
   bool thrown = false;
@@ -1526,6 +2918,67 @@ BOOST_AUTO_TEST_CASE(arg_parse_arg_vector_verbose) {
   BOOST_CHECK(!args.verbose());
 }
 
+
+BOOST_AUTO_TEST_CASE(arg_parse_arg_vector_separate_large) {
+  StrVector v;
+  v.push_back("--infile");
+  v.push_back("blabla");
+  v.push_back("--outfile");
+  v.push_back("blabla");
+  Arguments args(Arguments::parse_arg_vector(v));
+  BOOST_CHECK(!args.separate_large());
+
+  v.push_back("--separate-large");
+  args = Arguments::parse_arg_vector(v);
+  BOOST_CHECK(args.separate_large());
+}
+
+
+BOOST_AUTO_TEST_CASE(arg_parse_arg_vector_compact_regions) {
+  StrVector v;
+  v.push_back("--infile");
+  v.push_back("blabla");
+  v.push_back("--outfile");
+  v.push_back("blabla");
+  Arguments args(Arguments::parse_arg_vector(v));
+  BOOST_CHECK(!args.compact_regions());
+
+  v.push_back("--compact-regions");
+  args = Arguments::parse_arg_vector(v);
+  BOOST_CHECK(args.compact_regions());
+}
+
+
+BOOST_AUTO_TEST_CASE(arg_parse_arg_vector_trace) {
+  StrVector v;
+  v.push_back("--infile");
+  v.push_back("blabla");
+  v.push_back("--outfile");
+  v.push_back("blabla");
+  Arguments args(Arguments::parse_arg_vector(v));
+  BOOST_CHECK(args.trace_file().empty());
+
+  v.push_back("--trace");
+  v.push_back("packets.trace");
+  args = Arguments::parse_arg_vector(v);
+  BOOST_CHECK_EQUAL(args.trace_file(), "packets.trace");
+}
+
+
+BOOST_AUTO_TEST_CASE(arg_parse_arg_vector_autotune) {
+  StrVector v;
+  v.push_back("--infile");
+  v.push_back("blabla");
+  v.push_back("--outfile");
+  v.push_back("blabla");
+  Arguments args(Arguments::parse_arg_vector(v));
+  BOOST_CHECK(!args.autotune());
+
+  v.push_back("--autotune");
+  args = Arguments::parse_arg_vector(v);
+  BOOST_CHECK(args.autotune());
+}
+
 /*****************************************************************************
  *                        E M I T T E R   T E S T S                          *
  *****************************************************************************/
@@ -1607,6 +3060,129 @@ BOOST_AUTO_TEST_CASE(emit_emit_leaf) {
 }
 
 
+BOOST_AUTO_TEST_CASE(emit_emit_pushed_rules) {
+  NODE_WITH_COMMON_RULES;
+  Emitter emitter(NodeRefVector(), RuleVector(), DomainVector(),
+      Arguments::SEARCH_LINEAR);
+  stringstream out;
+  emitter.emit_pushed_rules(&node, "CURRENT_CHAIN", out);
+
+  stringstream expect;
+  expect << "# pushed rules" << endl
+      << "-A CURRENT_CHAIN -p tcp --dport 443 -j DROP" << endl
+      << "-A CURRENT_CHAIN -p tcp --dport 80 -j ACCEPT" << endl;
+  BOOST_CHECK_EQUAL(out.str(), expect.str());
+  Rule::delete_rules(rules);
+}
+
+
+BOOST_AUTO_TEST_CASE(emit_emit_tree_shared_leaves) {
+  RuleVector rules;
+  rules.push_back(parse::parse_rule("-A CHAIN -p tcp --sport 10:19 -j ACCEPT"));
+  rules.push_back(parse::parse_rule("-A CHAIN -p tcp --sport 0:29 -j DROP"));
+  TreeNode tree(rules, make_tuple(0, rules.size() - 1));
+  tree.cut(0, 2);
+  Emitter emitter(NodeRefVector(), RuleVector(), DomainVector(),
+      Arguments::SEARCH_LINEAR);
+  stringstream out;
+  StrVector chains;
+  emitter.emit_tree(&tree, "CHAIN_0", 0, "CHAIN_1", true, out, chains);
+  // the outer children share the chain of the first one
+  const string emitted(out.str());
+  size_t num_leaves = 0;
+  for (size_t pos = emitted.find("# leaf node"); pos != string::npos;
+      pos = emitted.find("# leaf node", pos + 1))
+    ++num_leaves;
+  BOOST_CHECK_EQUAL(num_leaves, 2);
+  BOOST_CHECK(emitted.find("CHAIN_0_0_3") == string::npos);
+  BOOST_CHECK(emitted.find("-j CHAIN_0_0_1") != string::npos);
+  std::set<string> unique_chains(chains.begin(), chains.end());
+  BOOST_CHECK_EQUAL(unique_chains.size(), chains.size());
+  Rule::delete_rules(rules);
+}
+
+
+BOOST_AUTO_TEST_CASE(emit_multi_field_dispatch) {
+  RuleVector rules;
+  for (size_t i = 0; i < 8; ++i) {
+    stringstream ss;
+    ss << "-A CHAIN -p tcp --sport " << (i / 4) * 100 << ":"
+        << (i / 4) * 100 + 99 << " --dport " << (i % 4) * 10 << ":"
+        << (i % 4) * 10 + 9 << " -j DROP";
+    rules.push_back(parse::parse_rule(ss.str()));
+  }
+  TreeNode tree(rules, make_tuple(0, 7));
+  std::vector<size_t> dims;
+  dims.push_back(0);
+  dims.push_back(1);
+  std::vector<size_t> num_cuts;
+  num_cuts.push_back(1);
+  num_cuts.push_back(3);
+  tree.hyper_cut(dims, num_cuts);
+  BOOST_REQUIRE_EQUAL(tree.num_children(), 8);
+  tree.compute_numbering();
+  Emitter emitter(NodeRefVector(), RuleVector(), DomainVector(),
+      Arguments::SEARCH_LINEAR);
+  stringstream out;
+  StrVector chains;
+  emitter.emit_simple_binary_dispatch(&tree, "CHAIN", 0, 0, out, chains);
+
+  stringstream expect;
+  expect << "# Multi-field binary search, chain CHAIN" << endl
+      << "# check if binary search terminates" << endl
+      << "-A CHAIN_0_0 -p tcp --sport 0:99 --dport 30:39 -j CHAIN_0_4" << endl
+      << "# binary search left branch" << endl
+      << "-A CHAIN_0_0 -p tcp --sport 0:99 --dport 0:29 -j CHAIN_0_0_1" << endl
+      << "# binary search right branch" << endl
+      << "-A CHAIN_0_0 -j CHAIN_0_0_5" << endl
+      << "# direct dispatch" << endl
+      << "-A CHAIN_0_0_1 -p tcp --sport 0:99 --dport 0:9 -j CHAIN_0_1" << endl
+      << "-A CHAIN_0_0_1 -p tcp --sport 0:99 --dport 10:19 -j CHAIN_0_2"
+      << endl
+      << "-A CHAIN_0_0_1 -j CHAIN_0_3" << endl
+      << "# direct dispatch" << endl
+      << "-A CHAIN_0_0_5 -p tcp --sport 100:199 --dport 0:9 -j CHAIN_0_5"
+      << endl
+      << "-A CHAIN_0_0_5 -p tcp --sport 100:199 --dport 10:19 -j CHAIN_0_6"
+      << endl
+      << "-A CHAIN_0_0_5 -p tcp --sport 100:199 --dport 20:29 -j CHAIN_0_7"
+      << endl
+      << "-A CHAIN_0_0_5 -j CHAIN_0_8" << endl << endl;
+  BOOST_CHECK_EQUAL(out.str(), expect.str());
+  Rule::delete_rules(rules);
+}
+
+
+BOOST_AUTO_TEST_CASE(emit_split_dispatch) {
+  RuleVector rules;
+  grid_rules(64, rules);
+  TreeNode tree(rules, make_tuple(0, rules.size() - 1));
+  tree.split(0, 399);
+  BOOST_REQUIRE_EQUAL(tree.num_children(), 2);
+  tree.compute_numbering();
+  Emitter emitter(NodeRefVector(), RuleVector(), DomainVector(),
+      Arguments::SEARCH_LINEAR);
+  stringstream out;
+  StrVector chains;
+  emitter.emit_simple_binary_dispatch(&tree, "CHAIN", 0, 0, out, chains);
+
+  stringstream expect;
+  expect << "# Split, chain CHAIN" << endl
+      << "-A CHAIN_0_0 -p tcp --sport 0:399 -j CHAIN_0_1" << endl
+      << "-A CHAIN_0_0 -j CHAIN_0_2" << endl << endl;
+  BOOST_CHECK_EQUAL(out.str(), expect.str());
+  // a single equidistant cut also has two children, but is searched as usual
+  tree.reset_cut();
+  tree.cut(0, 1);
+  BOOST_REQUIRE_EQUAL(tree.num_children(), 2);
+  tree.compute_numbering();
+  out.str("");
+  emitter.emit_simple_binary_dispatch(&tree, "CHAIN", 0, 0, out, chains);
+  BOOST_CHECK(out.str().find("# Split") == string::npos);
+  Rule::delete_rules(rules);
+}
+
+
 BOOST_AUTO_TEST_CASE(emit_num_to_ip) {
   BOOST_CHECK_EQUAL(Emitter::num_to_ip(0), "0.0.0.0");
   BOOST_CHECK_EQUAL(Emitter::num_to_ip(1), "0.0.0.1");
@@ -1628,14 +3204,71 @@ BOOST_AUTO_TEST_CASE(emit_emit_custom_default_rule) {
   BOOST_CHECK_EQUAL(out.str(), ss.str());
 }
 
+
+BOOST_AUTO_TEST_CASE(emit_rule_counter) {
+  RuleCounter counter;
+  ostream out(&counter);
+  out << "-A a -j b" << endl << "# -A comment" << endl << "-A" << endl
+      << "-X -A " << endl << endl << "-A c -j d" << endl;
+  BOOST_CHECK_EQUAL(counter.num_rules(), 2);
+  // the prefix may arrive in pieces
+  out << '-' << 'A';
+  BOOST_CHECK_EQUAL(counter.num_rules(), 2);
+  out << " e" << endl << "-A f";
+  BOOST_CHECK_EQUAL(counter.num_rules(), 4);
+}
+
 /*****************************************************************************
  *                           R U L E   T E S T S                             *
  *****************************************************************************/
 
-BOOST_AUTO_TEST_CASE(rule_src_with_patched_chain) {
+BOOST_AUTO_TEST_CASE(rule_write_with_patched_chain) {
   Rule* rule = parse::parse_rule("-A abc -p tcp -j DROP");
-  BOOST_CHECK_EQUAL(rule->src_with_patched_chain("blablub"),
-      std::string("-A blablub -p tcp -j DROP"));
+  stringstream ss;
+  rule->write_with_patched_chain(ss, "blablub");
+  BOOST_CHECK_EQUAL(ss.str(), "-A blablub -p tcp -j DROP");
+  delete rule;
+
+  // the chain is found by position, not by name
+  rule = parse::parse_rule("-A A -p tcp -j A");
+  ss.str("");
+  rule->write_with_patched_chain(ss, "B");
+  BOOST_CHECK_EQUAL(ss.str(), "-A B -p tcp -j A");
+  BOOST_CHECK(rule->src() == "-A A -p tcp -j A");
+  delete rule;
+
+  rule = parse::parse_rule("-A INPUT -m state -j ACCEPT");
+  ss.str("");
+  rule->write_with_patched_chain(ss, "B");
+  BOOST_CHECK_EQUAL(ss.str(), "-A B -m state -j ACCEPT");
+  delete rule;
+
+  rule = parse::parse_rule("-p tcp -j DROP");
+  ss.str("");
+  rule->write_with_patched_chain(ss, "B");
+  BOOST_CHECK_EQUAL(ss.str(), "-A B -p tcp -j DROP");
+  delete rule;
+}
+
+
+BOOST_AUTO_TEST_CASE(rule_copy_src) {
+  static_assert(!is_constructible<StrView, string&&>::value,
+      "views of temporary strings must not compile");
+  // a rule parsed from a string keeps its own copy of it
+  string text("-A abc -p tcp -j DROP");
+  Rule* rule = parse::parse_rule(text);
+  BOOST_CHECK(rule->src().data() != text.data());
+  text.assign(text.size(), 'x');
+  BOOST_CHECK(rule->src() == "-A abc -p tcp -j DROP");
+  stringstream ss;
+  rule->write_with_patched_chain(ss, "B");
+  BOOST_CHECK_EQUAL(ss.str(), "-A B -p tcp -j DROP");
+  delete rule;
+
+  // views are not copied
+  const StrView view(text);
+  rule = parse::parse_rule(view);
+  BOOST_CHECK(rule->src().data() == text.data());
   delete rule;
 }
 
@@ -1973,3 +3606,280 @@ BOOST_AUTO_TEST_CASE(binsearchtree_build_full_tree) {
   BOOST_CHECK_EQUAL(right->right()->end(), 10);
   BOOST_CHECK(right->right()->is_leaf());
 }
+
+
+
+BOOST_AUTO_TEST_CASE(binsearchtree_weighted_median) {
+  vector<size_t> weights(6, 0);
+  BOOST_CHECK_EQUAL(BinSearchTree::weighted_median(0, 5, weights), 2);
+  weights[4] = 10;
+  weights[1] = 1;
+  BOOST_CHECK_EQUAL(BinSearchTree::weighted_median(0, 5, weights), 4);
+  BOOST_CHECK_EQUAL(BinSearchTree::weighted_median(0, 3, weights), 1);
+  BOOST_CHECK_EQUAL(BinSearchTree::weighted_median(2, 2, weights), 2);
+  // the last index of a range is never the lookup
+  BOOST_CHECK_EQUAL(BinSearchTree::weighted_median(3, 4, weights), 3);
+}
+
+
+BOOST_AUTO_TEST_CASE(binsearchtree_build_weighted_tree) {
+  vector<size_t> weights(11, 1);
+  weights[9] = 100;
+  BinSearchTree tree(0, 10, weights);
+  // the heavy index is looked up first
+  BOOST_CHECK_EQUAL(tree.lookup_index(), 9);
+  BOOST_REQUIRE(tree.has_left_child());
+  BOOST_CHECK_EQUAL(tree.left()->start(), 0);
+  BOOST_CHECK_EQUAL(tree.left()->end(), 8);
+  BOOST_CHECK_EQUAL(tree.left()->lookup_index(), 4);
+  BOOST_CHECK_EQUAL(tree.right()->start(), 10);
+  BOOST_CHECK(tree.right()->is_leaf());
+}
+
+/*****************************************************************************
+ *                            P O O L   T E S T S                            *
+ *****************************************************************************/
+
+BOOST_AUTO_TEST_CASE(pool_run_all_tasks) {
+  for (size_t workers = 1; workers <= 4; ++workers) {
+    WorkerPool pool(workers);
+    vector<size_t> results(100, 0);
+    pool.run(results.size(), [&results] (const size_t i) {
+      results[i] = i * i;
+    });
+    for (size_t i = 0; i < results.size(); ++i)
+      BOOST_CHECK_EQUAL(results[i], i * i);
+  }
+}
+
+
+BOOST_AUTO_TEST_CASE(pool_run_rethrows) {
+  WorkerPool pool(4);
+  atomic<size_t> num_run(0);
+  bool thrown = false;
+  try {
+    pool.run(16, [&num_run] (const size_t i) {
+      ++num_run;
+      if (i == 3)
+        throw string("task failed");
+    });
+  } catch (const string& msg) {
+    thrown = true;
+    BOOST_CHECK_EQUAL(msg, "task failed");
+  }
+  BOOST_CHECK(thrown);
+  BOOST_CHECK(num_run.load() >= 1);
+}
+
+/*****************************************************************************
+ *                           T R A C E   T E S T S                           *
+ *****************************************************************************/
+
+BOOST_AUTO_TEST_CASE(trace_parse_trace_line) {
+  dim_t point[PacketSet::NUM_DIMS];
+  BOOST_CHECK(trace::parse_trace_line("3232235777\t167772161\t80\t443\n",
+      point));
+  BOOST_CHECK_EQUAL(point[0], 80);
+  BOOST_CHECK_EQUAL(point[1], 443);
+  BOOST_CHECK_EQUAL(point[2], 3232235777U);
+  BOOST_CHECK_EQUAL(point[3], 167772161);
+  // further columns are ignored
+  BOOST_CHECK(trace::parse_trace_line("1\t2\t3\t4\t6\t17\n", point));
+  BOOST_CHECK_EQUAL(point[0], 3);
+  BOOST_CHECK(!trace::parse_trace_line("1\t2\t3\n", point));
+  BOOST_CHECK(!trace::parse_trace_line("1\t2\t3\t65536\n", point));
+  BOOST_CHECK(!trace::parse_trace_line("4294967296\t2\t3\t4\n", point));
+  BOOST_CHECK(!trace::parse_trace_line("\n", point));
+}
+
+
+BOOST_AUTO_TEST_CASE(trace_read_trace_file) {
+  ofstream out;
+  const string fn("___TEST_FILE___");
+  out.open(fn);
+  // long lines are read as a whole, the tail of the second one does not
+  // become a packet of its own
+  out << "1\t2\t3\t4\n5\t6\t7\t8\t" << string(503, 'x') << "1\t2\t3\t4\n"
+      << "broken\n\n" << string(1000, '9') << "\n1\t2\t3\t4\n";
+  out.close();
+  PacketSet packets;
+  BOOST_CHECK_EQUAL(trace::read_trace_file(fn, packets), 2);
+  std::remove(fn.c_str());
+  // identical packets are merged
+  BOOST_REQUIRE_EQUAL(packets.size(), 2);
+  BOOST_CHECK_EQUAL(packets.total_weight(), 3);
+  BOOST_CHECK_EQUAL(packets.coordinate(0, 2), 1);
+  BOOST_CHECK_EQUAL(packets.weight(0), 2);
+  BOOST_CHECK_EQUAL(packets.coordinate(1, 0), 7);
+  BOOST_CHECK_EQUAL(packets.weight(1), 1);
+
+  bool thrown = false;
+  try {
+    trace::read_trace_file("___SOME_VERY_NONEXISTING_FILE___", packets);
+  } catch (const string& msg) {
+    thrown = true;
+  }
+  BOOST_CHECK(thrown);
+}
+
+
+BOOST_AUTO_TEST_CASE(trace_packetset_inside) {
+  PacketSet packets;
+  const dim_t point[PacketSet::NUM_DIMS] = {7, 0, 0, 0};
+  packets.add(point, 1);
+  DimVector bounds;
+  bounds.push_back(make_tuple(0, 10));
+  BOOST_CHECK(packets.inside(0, Box(bounds)));
+  bounds[0] = make_tuple(8, 10);
+  BOOST_CHECK(!packets.inside(0, Box(bounds)));
+}
+
+
+BOOST_AUTO_TEST_CASE(trace_packetset_sort_by) {
+  PacketSet packets;
+  const dim_t point1[PacketSet::NUM_DIMS] = {7, 1, 0, 0};
+  const dim_t point2[PacketSet::NUM_DIMS] = {3, 2, 0, 0};
+  packets.add(point1, 1);
+  packets.add(point2, 4);
+  vector<uint32_t> positions;
+  packets.sort_by(0, positions);
+  BOOST_REQUIRE_EQUAL(positions.size(), 2);
+  BOOST_CHECK_EQUAL(positions[0], 1);
+  BOOST_CHECK_EQUAL(positions[1], 0);
+  packets.sort_by(1, positions);
+  BOOST_CHECK_EQUAL(positions[0], 0);
+  BOOST_CHECK_EQUAL(positions[1], 1);
+  BOOST_CHECK_EQUAL(packets.total_weight(), 5);
+  packets.clear();
+  BOOST_CHECK(packets.empty());
+  BOOST_CHECK_EQUAL(packets.total_weight(), 0);
+}
+
+/*****************************************************************************
+ *                          M A P P E D   T E S T S                          *
+ *****************************************************************************/
+
+BOOST_AUTO_TEST_CASE(mapped_strview) {
+  const string s("-A INPUT -j DROP");
+  const StrView view(s);
+  BOOST_CHECK_EQUAL(view.size(), s.size());
+  BOOST_CHECK(view == "-A INPUT -j DROP");
+  BOOST_CHECK(view.substr(3, 5) == "INPUT");
+  BOOST_CHECK(view.substr(12) == "DROP");
+  BOOST_CHECK(view.substr(12, 100) == "DROP");
+  BOOST_CHECK_EQUAL(view.find(' '), 2);
+  BOOST_CHECK_EQUAL(view.find(' ', 3), 8);
+  BOOST_CHECK_EQUAL(view.find('x'), StrView::npos);
+  BOOST_CHECK(view.substr(3, 5).str() == "INPUT");
+  BOOST_CHECK(view != "-A INPUT");
+  BOOST_CHECK(StrView() == "");
+  stringstream ss;
+  ss << view.substr(0, 2);
+  BOOST_CHECK(ss.str() == "-A");
+}
+
+
+BOOST_AUTO_TEST_CASE(mapped_file_lines) {
+  ofstream out;
+  const string fn("___TEST_FILE___");
+  out.open(fn);
+  out << "a\r\n  b c \n\n   \n\t\nd";
+  out.close();
+
+  ViewVector lines;
+  {
+    MappedFile file(fn);
+    file.lines(lines);
+    BOOST_REQUIRE_EQUAL(lines.size(), 3);
+    BOOST_CHECK(lines[0] == "a");
+    BOOST_CHECK(lines[1] == "b c");
+    BOOST_CHECK(lines[2] == "d");
+    BOOST_CHECK(lines[0].data() == file.data());
+  }
+  lines.clear();
+  std::remove(fn.c_str());
+
+  out.open(fn);
+  out.close();
+  {
+    MappedFile file(fn);
+    file.lines(lines);
+    BOOST_CHECK_EQUAL(file.size(), 0);
+    BOOST_CHECK_EQUAL(lines.size(), 0);
+  }
+  std::remove(fn.c_str());
+
+  BOOST_CHECK_THROW(MappedFile("___SOME_VERY_NONEXISTING_FILE___"),
+      std::string);
+}
+
+
+/*****************************************************************************
+ *                            T U N E   T E S T S                            *
+ *****************************************************************************/
+
+BOOST_AUTO_TEST_CASE(tune_autotune) {
+  RuleVector rules;
+  grid_rules(64, rules);
+  const ChainVector chains(1, rules);
+  const vector<DomainVector> chain_domains(1,
+      DomainVector(1, make_tuple(0, rules.size() - 1)));
+  const Arguments args;
+  const PacketSet packets;
+  const DefaultPolicies policies;
+  stringstream table;
+  const Arguments tuned(tune::autotune(chains, chain_domains, args, packets,
+      policies, table));
+
+  // score every candidate on its own, counting the rules in the full output
+  vector<Arguments> candidates;
+  tune::candidates(args, candidates);
+  BOOST_REQUIRE_EQUAL(candidates.size(), tune::num_candidates());
+  vector<size_t> num_rules;
+  vector<double> evaluations;
+  size_t best = 0;
+  for (size_t i = 0; i < candidates.size(); ++i) {
+    vector<NodeRefVector> chain_trees;
+    tune::build_trees(chains, chain_domains, candidates[i], packets, 1,
+        chain_trees);
+    evaluations.push_back(tune::expected_evaluations(chain_trees, chains,
+        chain_domains));
+    stringstream out;
+    vector<StrVector> chain_names;
+    tune::emit_trees(chain_trees, chains, chain_domains, args.search(),
+        policies, out, chain_names);
+    tune::delete_trees(chain_trees);
+    const string text(out.str());
+    size_t n = 0;
+    for (size_t pos = text.find("\n-A "); pos != string::npos;
+        pos = text.find("\n-A ", pos + 1))
+      ++n;
+    num_rules.push_back(n);
+    if (evaluations[i] < evaluations[best] || (evaluations[i]
+        == evaluations[best] && num_rules[i] < num_rules[best]))
+      best = i;
+  }
+  // some candidates are as cheap per packet, but emit more rules
+  size_t num_longer_ties = 0;
+  for (size_t i = 0; i < candidates.size(); ++i)
+    if (evaluations[i] == evaluations[best] && num_rules[i] > num_rules[best])
+      ++num_longer_ties;
+  BOOST_CHECK(num_longer_ties > 0);
+  BOOST_CHECK_EQUAL(tuned.binth(), candidates[best].binth());
+  BOOST_CHECK_EQUAL(tuned.spfac(), candidates[best].spfac());
+  BOOST_CHECK_EQUAL(tuned.dim_choice(), candidates[best].dim_choice());
+  BOOST_CHECK_EQUAL(tuned.cut_algo(), candidates[best].cut_algo());
+
+  // the score table reports the counted rules, one candidate per row
+  string line;
+  BOOST_REQUIRE(getline(table, line));
+  for (size_t i = 0; i < candidates.size(); ++i) {
+    BOOST_REQUIRE(getline(table, line));
+    stringstream score;
+    score << ": " << num_rules[i] << ", ";
+    BOOST_CHECK(line.find(score.str()) != string::npos);
+  }
+  BOOST_REQUIRE(getline(table, line));
+  BOOST_CHECK_EQUAL(line.find("# Autotuned: "), 0);
+  Rule::delete_rules(rules);
+}
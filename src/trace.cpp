@@ -0,0 +1,118 @@
+#include "trace.hpp"
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <unordered_map>
+
+bool PacketSet::inside(const size_t i, const Box& box) const {
+  const DimVector& bounds = box.box_bounds();
+  const size_t num_dims = bounds.size();
+  for (size_t dim = 0; dim < num_dims; ++dim) {
+    const dim_t value = coordinate(i, dim);
+    if (value < std::get<0>(bounds[dim]) || value > std::get<1>(bounds[dim]))
+      return false;
+  }
+  return true;
+}
+
+
+void PacketSet::sort_by(const size_t dim,
+    std::vector<uint32_t>& positions) const {
+
+  const size_t num_packets = size();
+  positions.resize(num_packets);
+  for (size_t i = 0; i < num_packets; ++i)
+    positions[i] = i;
+  std::sort(positions.begin(), positions.end(),
+      [this, dim] (const uint32_t a, const uint32_t b) {
+    return coordinate(a, dim) < coordinate(b, dim);
+  });
+}
+
+
+void PacketSet::clear() {
+  std::vector<dim_t>().swap(coordinates_);
+  std::vector<uint32_t>().swap(weights_);
+  total_weight_ = 0;
+}
+
+
+/*
+ * Parses a decimal number of at most max at the start of str and skips the
+ * tab or space after it.  Returns the position after the number or nullptr
+ * if there is none.
+ */
+static const char* parse_field(const char* str, const uint64_t max,
+    dim_t& value) {
+
+  if (*str < '0' || *str > '9')
+    return nullptr;
+  uint64_t number = 0;
+  for (; *str >= '0' && *str <= '9'; ++str) {
+    number = number * 10 + (*str - '0');
+    if (number > max)
+      return nullptr;
+  }
+  while (*str == '\t' || *str == ' ')
+    ++str;
+  value = number;
+  return str;
+}
+
+
+bool trace::parse_trace_line(const char* line, dim_t* point) {
+  // the trace starts with the addresses, the rule space with the ports
+  static const size_t dims[] = {2, 3, 0, 1};
+  static const uint64_t max_values[] = {UINT32_MAX, UINT32_MAX, 65535, 65535};
+  for (size_t k = 0; k < PacketSet::NUM_DIMS; ++k) {
+    line = parse_field(line, max_values[k], point[dims[k]]);
+    if (line == nullptr)
+      return false;
+  }
+  return true;
+}
+
+
+typedef std::array<dim_t, PacketSet::NUM_DIMS> Point;
+
+struct PointHash {
+  size_t operator()(const Point& point) const {
+    size_t hash = 14695981039346656037ULL;
+    for (size_t dim = 0; dim < PacketSet::NUM_DIMS; ++dim)
+      hash = (hash ^ point[dim]) * 1099511628211ULL;
+    return hash;
+  }
+};
+
+
+size_t trace::read_trace_file(const std::string& path, PacketSet& packets) {
+  FILE* file = fopen(path.c_str(), "r");
+  if (file == nullptr)
+    throw "Trace file '" + path + "' is not accessible!";
+  // packets repeat a lot in traces, so they are counted while streaming
+  std::unordered_map<Point, uint32_t, PointHash> counts;
+  std::vector<Point> order;
+  // getline grows the buffer as needed, so long lines are read as a whole
+  char* line = nullptr;
+  size_t capacity = 0;
+  size_t num_rejected = 0;
+  Point point;
+  while (getline(&line, &capacity, file) != -1) {
+    if (!trace::parse_trace_line(line, point.data())) {
+      if (line[strspn(line, " \t\r\n")] != '\0')
+        ++num_rejected;
+      continue;
+    }
+    uint32_t& count = counts[point];
+    if (count == 0)
+      order.push_back(point);
+    if (count < UINT32_MAX)
+      ++count;
+  }
+  free(line);
+  fclose(file);
+  for (size_t i = 0; i < order.size(); ++i)
+    packets.add(order[i].data(), counts[order[i]]);
+  return num_rejected;
+}
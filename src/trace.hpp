@@ -0,0 +1,93 @@
+#ifndef HITABLES_TRACE_HPP
+#define HITABLES_TRACE_HPP 1
+
+#include <cstdlib>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "box.hpp"
+
+/*
+ * Observed packets as points in the rule space, each with the number of
+ * times it was seen.  The coordinates are stored packet after packet, in the
+ * order of the rule dimensions: source port, destination port, source
+ * address and destination address.
+ */
+class PacketSet {
+public:
+  PacketSet() : total_weight_(0) {}
+
+  static const size_t NUM_DIMS = 4;
+
+  inline size_t size() const {return weights_.size();}
+
+  inline bool empty() const {return weights_.empty();}
+
+  inline dim_t coordinate(const size_t i, const size_t dim) const {
+    return coordinates_[i * PacketSet::NUM_DIMS + dim];
+  }
+
+  inline uint32_t weight(const size_t i) const {return weights_[i];}
+
+  /*
+   * Number of observed packets, i.e. the sum of all weights.
+   */
+  inline size_t total_weight() const {return total_weight_;}
+
+  inline void add(const dim_t* point, const uint32_t weight) {
+    for (size_t dim = 0; dim < PacketSet::NUM_DIMS; ++dim)
+      coordinates_.push_back(point[dim]);
+    weights_.push_back(weight);
+    total_weight_ += weight;
+  }
+
+  /*
+   * Appends the i-th packet of other.
+   */
+  inline void add(const PacketSet& other, const size_t i) {
+    add(&other.coordinates_[i * PacketSet::NUM_DIMS], other.weights_[i]);
+  }
+
+  /*
+   * Checks whether the i-th packet lies within the box in all of the box's
+   * dimensions.
+   */
+  bool inside(const size_t i, const Box& box) const;
+
+  /*
+   * Computes the positions of the packets ordered by their coordinate in the
+   * given dimension.
+   */
+  void sort_by(const size_t dim, std::vector<uint32_t>& positions) const;
+
+  void clear();
+
+private:
+  std::vector<dim_t> coordinates_;
+  std::vector<uint32_t> weights_;
+  size_t total_weight_;
+};
+
+
+namespace trace {
+
+  /*
+   * Parses a line of a packet trace: source address, destination address,
+   * source port and destination port as tab-separated decimal numbers, as
+   * read by eval/sender.c.  Further columns are ignored.  Writes the packet
+   * in the dimension order of PacketSet to point.
+   * Returns false if the line does not hold a packet.
+   */
+  bool parse_trace_line(const char* line, dim_t* point);
+
+  /*
+   * Streams a packet trace file into packets, merging identical packets into
+   * one with the number of occurrences as its weight.  Lines that do not
+   * hold a packet are skipped.  Returns the number of skipped lines that are
+   * not blank.
+   * Throws an std::string if the file is not accessible.
+   */
+  size_t read_trace_file(const std::string& path, PacketSet& packets);
+}
+
+#endif // HITABLES_TRACE_HPP
@@ -1,116 +1,728 @@
 #include "treenode.hpp"
+#include "pool.hpp"
+#include <unordered_map>
+#include <thread>
+#include <atomic>
 
-/*
- * Takes the boxes resulting from a local cut and the rules in a tree node and
- * builds up the children vector.
- */
-static void build_children(const std::vector<Box>& result_boxes,
-    const std::vector<const Rule*>& rules,
-    std::vector<TreeNode>& children) {
+RuleOrders::RuleOrders(const RuleTable& table, const RuleIdVector& ids,
+    const size_t num_dims) : by_start_(num_dims), by_end_(num_dims) {
 
-  const size_t num_result_boxes = result_boxes.size();
-  const size_t num_rules = rules.size();
-  for (size_t i = 0; i < num_result_boxes; ++i) {
-    const Box& node_box = result_boxes[i];
-    TreeNode node(node_box);
-    for (size_t j = 0; j < num_rules; ++j) {
-      if (rules[j]->box().collide(node_box))
-        node.add_rule(rules[j]);
+  const size_t num_rules = ids.size();
+  PositionVector positions(num_rules);
+  for (size_t i = 0; i < num_rules; ++i)
+    positions[i] = i;
+  for (size_t dim = 0; dim < num_dims; ++dim) {
+    by_start_[dim] = positions;
+    std::stable_sort(by_start_[dim].begin(), by_start_[dim].end(),
+        [&table, &ids, dim] (const uint32_t a, const uint32_t b) {
+      return table.start(dim, ids[a]) < table.start(dim, ids[b]);
+    });
+    by_end_[dim] = positions;
+    std::stable_sort(by_end_[dim].begin(), by_end_[dim].end(),
+        [&table, &ids, dim] (const uint32_t a, const uint32_t b) {
+      return table.end(dim, ids[a]) < table.end(dim, ids[b]);
+    });
+  }
+}
+
+
+void RuleOrders::derive(const std::vector<PositionVector>& child_positions,
+    const std::vector<RuleOrders*>& child_orders) const {
+
+  const size_t num_rules = by_start_.empty() ? 0 : by_start_[0].size();
+  const size_t num_children = child_positions.size();
+  // invert the memberships: for every rule of this node, list the children
+  // that received it along with its position within each child
+  PositionVector offsets(num_rules + 1, 0);
+  for (size_t i = 0; i < num_children; ++i) {
+    if (child_orders[i] == nullptr)
+      continue;
+    const PositionVector& positions = child_positions[i];
+    for (size_t j = 0; j < positions.size(); ++j)
+      ++offsets[positions[j] + 1];
+  }
+  for (size_t i = 0; i < num_rules; ++i)
+    offsets[i + 1] += offsets[i];
+  PositionVector member_child(offsets[num_rules]);
+  PositionVector member_position(offsets[num_rules]);
+  PositionVector next(offsets.begin(), offsets.end() - 1);
+  for (size_t i = 0; i < num_children; ++i) {
+    if (child_orders[i] == nullptr)
+      continue;
+    const PositionVector& positions = child_positions[i];
+    for (size_t j = 0; j < positions.size(); ++j) {
+      const uint32_t k = next[positions[j]]++;
+      member_child[k] = i;
+      member_position[k] = j;
+    }
+  }
+  // walking an ordering of this node visits every child's rules in the same
+  // relative order, so each child's ordering comes out sorted
+  auto filter = [&] (const PositionVector& order,
+      std::vector<PositionVector> RuleOrders::* target, const size_t dim) {
+    for (size_t i = 0; i < num_children; ++i)
+      if (child_orders[i] != nullptr)
+        (child_orders[i]->*target)[dim].reserve(child_positions[i].size());
+    for (size_t i = 0; i < num_rules; ++i) {
+      const uint32_t pos = order[i];
+      for (uint32_t k = offsets[pos]; k < offsets[pos + 1]; ++k)
+        (child_orders[member_child[k]]->*target)[dim].push_back(
+            member_position[k]);
+    }
+  };
+  const size_t num_dims = by_start_.size();
+  for (size_t dim = 0; dim < num_dims; ++dim) {
+    filter(by_start_[dim], &RuleOrders::by_start_, dim);
+    filter(by_end_[dim], &RuleOrders::by_end_, dim);
+  }
+}
+
+
+NodeArena::NodeArena() : size_(0) {
+  for (size_t i = 0; i < NUM_BLOCKS; ++i)
+    blocks_[i] = nullptr;
+}
+
+
+NodeArena::~NodeArena() {
+  for (size_t i = 0; i < size_; ++i)
+    (*this)[i].~TreeNode();
+  for (size_t i = 0; i < NUM_BLOCKS; ++i)
+    ::operator delete(blocks_[i]);
+}
+
+
+uint32_t NodeArena::add_range(NodeVector& nodes) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const size_t num_nodes = nodes.size();
+  if (size_ + num_nodes > UINT32_MAX)
+    throw std::string("Too many tree nodes: node indices exceed 32 bits!");
+  const uint32_t first = size_;
+  for (size_t i = 0; i < num_nodes; ++i) {
+    const uint32_t index = first + i;
+    const size_t block = block_of(index);
+    if (blocks_[block] == nullptr)
+      blocks_[block] = static_cast<TreeNode*>(::operator new(
+          sizeof(TreeNode) << (block + MIN_BLOCK_BITS)));
+    new (&blocks_[block][index - block_start(block)])
+        TreeNode(std::move(nodes[i]));
+  }
+  size_ += num_nodes;
+  return first;
+}
+
+
+TreeNode::~TreeNode() {}
+
+
+bool TreeNode::sweep_children(const size_t dimension, const DimVector& slices,
+    std::vector<PositionVector>& candidates) const {
+
+  const size_t num_slices = slices.size();
+  if (num_slices == 0)
+    return false;
+  // the upper bounds of the slices, which must be ascending and leave no gaps
+  std::vector<dim_t> slice_ends(num_slices);
+  for (size_t i = 0; i < num_slices; ++i) {
+    if (std::get<0>(slices[i]) > std::get<1>(slices[i]))
+      return false;
+    if (i > 0 && std::get<0>(slices[i]) != uint64_t(slice_ends[i - 1]) + 1)
+      return false;
+    slice_ends[i] = std::get<1>(slices[i]);
+  }
+  const TableBox span(box_, dimension,
+      std::make_tuple(std::get<0>(slices[0]), slice_ends.back()));
+
+  candidates.assign(num_slices, PositionVector());
+  const RuleIdVector& ids = rule_set_.ids();
+  const size_t num_rules_ = ids.size();
+  for (size_t j = 0; j < num_rules_; ++j) {
+    if (!table_->collide(ids[j], span))
+      continue;
+    // the rule overlaps the slices from the first one that ends at or after
+    // its start to the one that contains its end
+    const auto first = std::lower_bound(slice_ends.begin(), slice_ends.end(),
+        table_->start(dimension, ids[j]));
+    const auto last = std::lower_bound(first, slice_ends.end() - 1,
+        table_->end(dimension, ids[j]));
+    for (auto it = first; it <= last; ++it)
+      candidates[it - slice_ends.begin()].push_back(j);
+  }
+  return true;
+}
+
+
+void TreeNode::build_children(const size_t dimension, const DimVector& slices,
+    NodeVector& children,
+    std::vector<PositionVector>* child_positions) const {
+
+  const size_t num_slices = slices.size();
+  std::vector<PositionVector> candidates;
+  const bool swept = num_slices >= SWEEP_MIN_CHILDREN
+      && sweep_children(dimension, slices, candidates);
+  std::unique_ptr<CollisionBlock> block;
+  if (!swept)
+    block.reset(new CollisionBlock(*table_, rule_set_.ids()));
+  std::vector<uint64_t> mask;
+  PositionVector collided;
+  size_t last_kept = num_slices;
+  for (size_t i = 0; i < num_slices; ++i) {
+    if (!swept) {
+      // visit the colliding rules in ascending order
+      block->collide(TableBox(box_, dimension, slices[i]), mask);
+      collided.clear();
+      const size_t num_words = mask.size();
+      for (size_t w = 0; w < num_words; ++w)
+        for (uint64_t word = mask[w]; word != 0; word &= word - 1)
+          collided.push_back(w * 64 + __builtin_ctzll(word));
+    }
+    const PositionVector& colliding = swept ? candidates[i] : collided;
+    // a child is kept if it receives a rule, which is the case if any rule
+    // collides, as the first one cannot be shadowed; only then its box is
+    // created
+    if (colliding.empty())
+      continue;
+    const size_t num_children = children.size();
+    build_child(box_.piece(dimension, slices[i]), colliding, children,
+        child_positions);
+    if (children.size() == num_children)
+      continue;
+    // a child with the same rules as its neighbour shares its subtree, which
+    // is then built once over both slices, unless they would span this
+    // node's box, as such a child could be cut the same way forever
+    if (last_kept + 1 == i
+        && children[num_children - 1].rule_set_ == children.back().rule_set_) {
+      TreeNode& neighbour = children[num_children - 1];
+      const DimTuple merged(
+          std::get<0>(neighbour.box_.box_bounds()[dimension]),
+          std::get<1>(slices[i]));
+      if (merged != box_.box_bounds()[dimension]) {
+        neighbour.box_ = box_.piece(dimension, merged);
+        children.pop_back();
+        if (child_positions != nullptr)
+          child_positions->pop_back();
+      }
     }
-    // add this node to the children if it is not empty
-    if (node.num_rules() > 0)
-      children.push_back(node);
+    last_kept = i;
   }
 }
 
 
-void TreeNode::cut(const dim_t dimension, const size_t num_cuts) {
+void TreeNode::build_child(const Box& box, const PositionVector& colliding,
+    NodeVector& children,
+    std::vector<PositionVector>* child_positions) const {
+
+  TreeNode node(box, table_, arena_);
+  PositionVector positions;
+  const size_t num_colliding = colliding.size();
+  for (size_t k = 0; k < num_colliding; ++k)
+    if (node.add_rule_id(rule_set_.ids()[colliding[k]]))
+      positions.push_back(colliding[k]);
+  node.release_shadow_index();
+  if (node.num_rules() == 0)
+    return;
+  children.push_back(std::move(node));
+  if (child_positions != nullptr)
+    child_positions->push_back(std::move(positions));
+}
+
+
+void TreeNode::trial_cut(const dim_t dimension, const size_t num_cuts,
+    NodeVector& children,
+    std::vector<PositionVector>* child_positions) const {
+
+  DimVector slices;
+  box_.cut_slices(dimension, num_cuts, slices);
+  build_children(dimension, slices, children, child_positions);
+}
+
+
+void TreeNode::attach_children(NodeVector& children) {
+  num_children_ = children.size();
+  first_child_ = num_children_ == 0 ? 0 : arena_->add_range(children);
+}
+
+
+void TreeNode::cut(const dim_t dimension, const size_t num_cuts,
+    std::vector<PositionVector>* child_positions) {
+
   if (has_been_cut_)
     return;
   // perform the cut
-  std::vector<Box> result_boxes;
-  box_.cut(dimension, num_cuts, result_boxes);
-  build_children(result_boxes, rules_, children_);
+  NodeVector children;
+  trial_cut(dimension, num_cuts, children, child_positions);
+  attach_children(children);
   // add meta information
   has_been_cut_ = true;
   cut_dim_ = dimension;
+  cut_dims_ = 1U << dimension;
   num_cuts_ = num_cuts;
 }
 
 
+/*
+ * The equidistant slices of a hyper cut in one dimension.  The slice that
+ * holds a value is found arithmetically, mirroring the piece boundaries of
+ * Box::cut.
+ */
+class GridAxis {
+public:
+  GridAxis(const Box& box, const size_t dimension, const size_t num_cuts)
+      : dimension_(dimension),
+      start_(std::get<0>(box.box_bounds()[dimension])),
+      end_(std::get<1>(box.box_bounds()[dimension])),
+      step_(uint64_t((end_ - start_) / (num_cuts + 1)) + 1),
+      num_cuts_(num_cuts) {}
+
+  inline size_t dimension() const {return dimension_;}
+
+  inline size_t num_slices() const {return num_cuts_ + 1;}
+
+  /*
+   * Returns the index of the slice that holds the given value, which is
+   * clamped to the box.
+   */
+  inline size_t slice_of(const dim_t value) const {
+    if (value <= start_)
+      return 0;
+    const uint64_t slice = (uint64_t(value < end_ ? value : end_) - start_)
+        / step_;
+    return slice < num_cuts_ ? slice : num_cuts_;
+  }
+
+private:
+  size_t dimension_;
+  dim_t start_;
+  dim_t end_;
+  uint64_t step_;
+  size_t num_cuts_;
+};
+
+
+void TreeNode::hyper_cut(const std::vector<size_t>& dimensions,
+    const std::vector<size_t>& num_cuts,
+    std::vector<PositionVector>* child_positions) {
+
+  if (has_been_cut_)
+    return;
+  const size_t num_cut_dims = dimensions.size();
+  if (num_cut_dims == 1) {
+    cut(dimensions[0], num_cuts[0], child_positions);
+    return;
+  }
+  std::vector<GridAxis> axes;
+  std::vector<DimVector> slices(num_cut_dims);
+  // the stride of a dimension in the lexicographic numbering of the cells
+  std::vector<size_t> strides(num_cut_dims);
+  size_t num_cells = 1;
+  for (size_t k = num_cut_dims; k-- > 0;) {
+    axes.insert(axes.begin(), GridAxis(box_, dimensions[k], num_cuts[k]));
+    box_.cut_slices(dimensions[k], num_cuts[k], slices[k]);
+    strides[k] = num_cells;
+    num_cells *= axes.front().num_slices();
+  }
+
+  // assign every rule to the block of cells that its box overlaps
+  std::vector<PositionVector> candidates(num_cells);
+  const TableBox frame(box_);
+  const RuleIdVector& ids = rule_set_.ids();
+  const size_t num_rules_ = ids.size();
+  std::vector<size_t> first(num_cut_dims);
+  std::vector<size_t> last(num_cut_dims);
+  std::vector<size_t> current(num_cut_dims);
+  for (size_t j = 0; j < num_rules_; ++j) {
+    if (!table_->collide(ids[j], frame))
+      continue;
+    size_t cell = 0;
+    for (size_t k = 0; k < num_cut_dims; ++k) {
+      const size_t dim = axes[k].dimension();
+      first[k] = axes[k].slice_of(table_->start(dim, ids[j]));
+      last[k] = axes[k].slice_of(table_->end(dim, ids[j]));
+      current[k] = first[k];
+      cell += first[k] * strides[k];
+    }
+    for (;;) {
+      candidates[cell].push_back(j);
+      // advance to the next cell of the block, last dimension first
+      size_t k = num_cut_dims;
+      while (k-- > 0 && current[k] == last[k]) {
+        cell -= (current[k] - first[k]) * strides[k];
+        current[k] = first[k];
+      }
+      if (k >= num_cut_dims)
+        break;
+      ++current[k];
+      cell += strides[k];
+    }
+  }
+
+  NodeVector children;
+  DimVector bounds(box_.box_bounds());
+  for (size_t cell = 0; cell < num_cells; ++cell) {
+    if (candidates[cell].empty())
+      continue;
+    for (size_t k = 0; k < num_cut_dims; ++k)
+      bounds[dimensions[k]] = slices[k][cell / strides[k] % slices[k].size()];
+    build_child(Box(bounds), candidates[cell], children, child_positions);
+  }
+  attach_children(children);
+  // add meta information
+  has_been_cut_ = true;
+  cut_dim_ = dimensions[0];
+  cut_dims_ = 0;
+  for (size_t k = 0; k < num_cut_dims; ++k)
+    cut_dims_ |= 1U << dimensions[k];
+  num_cuts_ = num_cells - 1;
+}
+
+
+size_t TreeNode::hyper_space_measure(const std::vector<size_t>& dimensions,
+    const std::vector<size_t>& num_cuts) const {
+
+  const size_t num_cut_dims = dimensions.size();
+  std::vector<GridAxis> axes;
+  size_t num_cells = 1;
+  for (size_t k = 0; k < num_cut_dims; ++k) {
+    axes.push_back(GridAxis(box_, dimensions[k], num_cuts[k]));
+    num_cells *= axes.back().num_slices();
+  }
+  const TableBox frame(box_);
+  const RuleIdVector& ids = rule_set_.ids();
+  const size_t num_rules_ = ids.size();
+  size_t space_measure = num_cells > 1 ? num_cells : 0;
+  for (size_t j = 0; j < num_rules_; ++j) {
+    if (!table_->collide(ids[j], frame))
+      continue;
+    size_t num_overlapped = 1;
+    for (size_t k = 0; k < num_cut_dims; ++k) {
+      const size_t dim = axes[k].dimension();
+      num_overlapped *= axes[k].slice_of(table_->end(dim, ids[j]))
+          - axes[k].slice_of(table_->start(dim, ids[j])) + 1;
+    }
+    space_measure += num_overlapped;
+  }
+  return space_measure;
+}
+
+
+void TreeNode::determine_hyper_cuts(const size_t spfac,
+    std::vector<size_t>& dimensions, std::vector<size_t>& num_cuts) const {
+
+  dimensions.clear();
+  num_cuts.clear();
+  const size_t num_dims = box_.num_dims();
+  std::vector<size_t> num_unique(num_dims);
+  size_t total_unique = 0;
+  const RuleOrders& sorted = orders();
+  std::vector<DimTuple> intervals;
+  for (size_t i = 0; i < num_dims; ++i) {
+    sorted.sorted_intervals(i, *table_, rule_set_.ids(), intervals);
+    // only the parts of the intervals within this node tell the rules apart
+    const DimTuple& bounds = box_.box_bounds()[i];
+    for (size_t j = 0; j < intervals.size(); ++j)
+      intervals[j] = std::make_tuple(
+          std::max(std::get<0>(intervals[j]), std::get<0>(bounds)),
+          std::min(std::get<1>(intervals[j]), std::get<1>(bounds)));
+    // intervals with equal start points still need to be ordered by their
+    // end points
+    std::sort(intervals.begin(), intervals.end());
+    num_unique[i] = std::unique(intervals.begin(), intervals.end())
+        - intervals.begin();
+    total_unique += num_unique[i];
+  }
+  // pick the dimensions with at least the average number of unique rule
+  // intervals that can still be cut
+  std::vector<size_t> max_cuts;
+  for (size_t i = 0; i < num_dims; ++i) {
+    const DimTuple& interval = box_.box_bounds()[i];
+    const dim_t max_cuts_in_dim = std::get<1>(interval) - std::get<0>(interval);
+    if (num_unique[i] > 1 && num_unique[i] * num_dims >= total_unique
+        && max_cuts_in_dim > 0) {
+      dimensions.push_back(i);
+      max_cuts.push_back(max_cuts_in_dim);
+    }
+  }
+  if (dimensions.size() == 1) {
+    // a single dimension is cut as in HiCuts
+    num_cuts.push_back(determine_number_of_cuts(dimensions[0], spfac));
+    return;
+  }
+  // double the number of pieces per dimension in turn while the space measure
+  // stays within the bound
+  num_cuts.assign(dimensions.size(), 1);
+  const size_t threshold = space_measure_upper_bound(spfac);
+  for (bool grown = true; grown;) {
+    grown = false;
+    for (size_t k = 0; k < dimensions.size(); ++k) {
+      const size_t current = num_cuts[k];
+      num_cuts[k] = min(2 * current + 1, max_cuts[k]);
+      if (num_cuts[k] > current
+          && hyper_space_measure(dimensions, num_cuts) < threshold)
+        grown = true;
+      else
+        num_cuts[k] = current;
+    }
+  }
+}
+
+
+void TreeNode::split(const size_t dimension, const dim_t point,
+    std::vector<PositionVector>* child_positions) {
+
+  if (has_been_cut_)
+    return;
+  // perform the split
+  const DimTuple& bounds = box_.box_bounds()[dimension];
+  DimVector slices;
+  slices.push_back(std::make_tuple(std::get<0>(bounds), point));
+  slices.push_back(std::make_tuple(point + 1, std::get<1>(bounds)));
+  NodeVector children;
+  build_children(dimension, slices, children, child_positions);
+  attach_children(children);
+  // add meta information
+  has_been_cut_ = true;
+  split_ = true;
+  cut_dim_ = dimension;
+  cut_dims_ = 1U << dimension;
+  num_cuts_ = 1;
+}
+
+
+bool TreeNode::best_split(size_t& dimension, dim_t& point) const {
+  const RuleIdVector& ids = rule_set_.ids();
+  const size_t num_rules = ids.size();
+  const RuleOrders& sorted = orders();
+  bool found = false;
+  size_t best_max = 0;
+  size_t best_sum = 0;
+  std::vector<dim_t> starts;
+  std::vector<dim_t> candidates;
+  for (size_t dim = 0; dim < box_.num_dims(); ++dim) {
+    const dim_t box_start = std::get<0>(box_.box_bounds()[dim]);
+    const dim_t box_end = std::get<1>(box_.box_bounds()[dim]);
+    const PositionVector& by_start = sorted.by_start(dim);
+    const PositionVector& by_end = sorted.by_end(dim);
+    // a split may take place behind every rule end and before every rule start
+    // within the box, in ascending order
+    starts.clear();
+    candidates.clear();
+    for (size_t i = 0; i < num_rules; ++i) {
+      const dim_t start = table_->start(dim, ids[by_start[i]]);
+      starts.push_back(start);
+      if (start > box_start)
+        candidates.push_back(start - 1);
+    }
+    const size_t num_start_candidates = candidates.size();
+    for (size_t i = 0; i < num_rules; ++i) {
+      const dim_t end = table_->end(dim, ids[by_end[i]]);
+      if (end < box_end)
+        candidates.push_back(end);
+    }
+    std::inplace_merge(candidates.begin(),
+        candidates.begin() + num_start_candidates, candidates.end());
+    // count the rules on both sides of every candidate, which grow and shrink
+    // monotonically
+    size_t num_left = 0;
+    size_t num_ended = 0;
+    for (size_t i = 0; i < candidates.size(); ++i) {
+      const dim_t candidate = candidates[i];
+      if (i > 0 && candidate == candidates[i - 1])
+        continue;
+      while (num_left < num_rules && starts[num_left] <= candidate)
+        ++num_left;
+      while (num_ended < num_rules
+          && table_->end(dim, ids[by_end[num_ended]]) <= candidate)
+        ++num_ended;
+      const size_t num_right = num_rules - num_ended;
+      const size_t larger = max(num_left, num_right);
+      const size_t sum = num_left + num_right;
+      if (!found || larger < best_max
+          || (larger == best_max && sum < best_sum)) {
+        found = true;
+        best_max = larger;
+        best_sum = sum;
+        dimension = dim;
+        point = candidate;
+      }
+    }
+  }
+  return found;
+}
+
+
 void TreeNode::unequal_cut(const dim_t dimension,
-    const std::vector<dim_t>& cut_points) {
+    const std::vector<dim_t>& cut_points,
+    std::vector<PositionVector>* child_positions) {
 
   if (has_been_cut_)
     return;
-  ///std::vector<const Rule*> rules_copy(rules_);
-  ///std::vector<dim_t> cut_points;
-  ///Rule::cut_points(dimension, rules_copy, cut_points);
   const size_t num_cut_points = cut_points.size();
   // check if an unequal cut can be performed at at least two cut points
   if (num_cut_points <= 1)
     return;
   // perform the cut
-  std::vector<Box> result_boxes;
-  box_.unequal_cut(dimension, cut_points, result_boxes);
-  build_children(result_boxes, rules_, children_);
+  DimVector slices;
+  box_.unequal_cut_slices(dimension, cut_points, slices);
+  NodeVector children;
+  build_children(dimension, slices, children, child_positions);
+  attach_children(children);
   // add meta information
   has_been_cut_ = true;
   cut_dim_ = dimension;
+  cut_dims_ = 1U << dimension;
   num_cuts_ = num_cut_points;
 }
 
 
+/*
+ * Checks whether two rules may both match a packet within the given box and
+ * decide differently, in which case their order matters.
+ */
+static bool rules_conflict_within(const RuleTable& table, const uint32_t a,
+    const uint32_t b, const Box& box) {
+
+  if (table.rule(a)->action() == table.rule(b)->action())
+    return false;
+  const DimVector& bounds = box.box_bounds();
+  for (size_t dim = 0; dim < bounds.size(); ++dim) {
+    const dim_t start = std::max(std::get<0>(bounds[dim]),
+        std::max(table.start(dim, a), table.start(dim, b)));
+    const dim_t end = std::min(std::get<1>(bounds[dim]),
+        std::min(table.end(dim, a), table.end(dim, b)));
+    if (start > end)
+      return false;
+  }
+  return true;
+}
+
+
+void TreeNode::push_common_rules(
+    std::vector<PositionVector>& child_positions) {
+
+  if (num_children_ < 2 || child_positions.size() != num_children_)
+    return;
+  const RuleIdVector& ids = rule_set_.ids();
+  const size_t num_rules = ids.size();
+  std::vector<uint32_t> num_holders(num_rules, 0);
+  for (size_t i = 0; i < num_children_; ++i)
+    for (size_t k = 0; k < child_positions[i].size(); ++k)
+      ++num_holders[child_positions[i][k]];
+  // visit the rules in order, keeping track of those staying in the children
+  std::vector<bool> pushed(num_rules, false);
+  PositionVector staying;
+  for (size_t pos = 0; pos < num_rules; ++pos) {
+    if (num_holders[pos] == num_children_) {
+      bool conflict = false;
+      for (size_t k = 0; k < staying.size() && !conflict; ++k)
+        conflict = rules_conflict_within(*table_, ids[staying[k]], ids[pos],
+            box_);
+      if (!conflict) {
+        pushed[pos] = true;
+        pushed_ids_.push_back(ids[pos]);
+        continue;
+      }
+    }
+    if (num_holders[pos] > 0)
+      staying.push_back(pos);
+  }
+  if (pushed_ids_.empty())
+    return;
+  for (size_t i = 0; i < num_children_; ++i) {
+    PositionVector& positions = child_positions[i];
+    RuleSet rule_set;
+    size_t num_staying = 0;
+    for (size_t k = 0; k < positions.size(); ++k) {
+      if (pushed[positions[k]])
+        continue;
+      positions[num_staying++] = positions[k];
+      rule_set.push_back(ids[positions[k]]);
+    }
+    positions.resize(num_staying);
+    child(i).rule_set_ = std::move(rule_set);
+  }
+}
+
+
+void TreeNode::compact_child_regions() {
+  // the slices of a hyper cut are kept in its dimensions
+  const uint32_t kept_dims = __builtin_popcount(cut_dims_) > 1 ? cut_dims_ : 0;
+  for (size_t i = 0; i < num_children_; ++i) {
+    TreeNode& node = child(i);
+    const RuleIdVector& ids = node.rule_set_.ids();
+    if (ids.empty())
+      continue;
+    DimVector bounds(node.box_.box_bounds());
+    for (size_t dim = 0; dim < bounds.size(); ++dim) {
+      if ((kept_dims >> dim) & 1)
+        continue;
+      dim_t start = table_->start(dim, ids[0]);
+      dim_t end = table_->end(dim, ids[0]);
+      for (size_t k = 1; k < ids.size(); ++k) {
+        start = std::min(start, table_->start(dim, ids[k]));
+        end = std::max(end, table_->end(dim, ids[k]));
+      }
+      // clip to the slice
+      bounds[dim] = std::make_tuple(std::max(start, std::get<0>(bounds[dim])),
+          std::min(end, std::get<1>(bounds[dim])));
+    }
+    node.box_ = Box(bounds);
+  }
+}
+
+
 size_t TreeNode::space_measure() const {
   size_t space_measure = 0;
-  const size_t num_children = children_.size();
-  for (size_t i = 0; i < num_children; ++i)
-    space_measure += children_[i].rules().size();
+  for (size_t i = 0; i < num_children_; ++i)
+    space_measure += child(i).num_rules();
   space_measure += (num_cuts_ == 0 ? 0 : num_cuts_ + 1);
   return space_measure;
 }
 
 
 size_t TreeNode::determine_number_of_cuts(const size_t dimension,
-    const size_t spfac) {
+    const size_t spfac) const {
+
+  const RuleOrders& sorted = orders();
+  const CutEvaluator evaluator(box_, *table_, rule_set_.ids(),
+      sorted.by_start(dimension), sorted.by_end(dimension), dimension);
+  return determine_number_of_cuts(evaluator, spfac);
+}
+
+
+size_t TreeNode::determine_number_of_cuts(const CutEvaluator& evaluator,
+    const size_t spfac) const {
 
-  const size_t num_rules = rules_.size();
+  const size_t num_rules = rule_set_.size();
   const size_t square_root = sqrt(num_rules);
   size_t num_cuts = max(4, square_root);
+  const size_t threshold = space_measure_upper_bound(spfac);
   for (;;) {
-    cut(dimension, num_cuts);
-    const size_t space = space_measure();
-    const size_t threshold = space_measure_upper_bound(spfac);
-    reset_cut();
+    const size_t space = evaluator.space_measure(num_cuts);
     if (space < threshold)
       num_cuts <<= 1;
     else
       break;
   }
+  const size_t dimension = evaluator.dimension();
   const DimTuple& interval = box_.box_bounds()[dimension];
-  //const dim_t max_cuts = std::get<1>(interval) - std::get<0>(interval) - 1;
   const dim_t max_cuts = std::get<1>(interval) - std::get<0>(interval);
   return min(num_cuts, max_cuts);
 }
 
 
-#include <iostream>
-#include <chrono>
-#include <thread>
-
 std::tuple<size_t, bool> TreeNode::dim_max_distinct_rules() const {
   const size_t num_dims = box_.num_dims();
   size_t* distinct_rules = new size_t[num_dims];
   size_t max_distinct = 0;
-  std::vector<const Rule*> rules_copy(rules_);
+  const RuleOrders& sorted = orders();
+  std::vector<DimTuple> intervals;
   for (size_t i = 0; i < num_dims; ++i) {
-    const size_t num_distinct = Rule::num_distinct_rules_in_dim(i, rules_copy);
+    sorted.sorted_intervals(i, *table_, rule_set_.ids(), intervals);
+    const size_t num_distinct = Rule::num_distinct_sorted_intervals(intervals);
     max_distinct = max_distinct < num_distinct ? num_distinct : max_distinct;
     distinct_rules[i] = num_distinct;
   }
   // gather all dimensions with the highest number of distinct rules
-  ////std::cout << "max distinct = " << max_distinct << std::endl;
-  ////std::cout << "num rules = " << rules_.size() << std::endl;
   std::vector<size_t> max_dims;
   dim_t max_dim_size = 0;
   const DimVector& bounds = box_.box_bounds();
@@ -131,30 +743,23 @@ std::tuple<size_t, bool> TreeNode::dim_max_distinct_rules() const {
       max_span_dims.push_back(dim);
   }
   // randomly select one of them
-  ////const size_t cut_dim = max_dims[rand() % max_dims.size()];
-  const size_t cut_dim = max_span_dims[rand() % max_span_dims.size()];
-  ///std::cout << "cut dim = " << cut_dim << std::endl;
-  //////return cut_dim;
+  const size_t cut_dim = max_span_dims[rng_() % max_span_dims.size()];
   const bool have_distinct_dim = max_distinct > 0;
   return std::make_tuple(cut_dim, have_distinct_dim);
 }
 
 
-size_t TreeNode::dim_least_max_rules_per_child(const size_t spfac) {
+size_t TreeNode::dim_least_max_rules_per_child(const size_t spfac) const {
   const size_t num_dims = box_.num_dims();
   size_t* least_max_nodes = new size_t[num_dims];
-  size_t least_max = rules_.size() + 1;
+  size_t least_max = rule_set_.size() + 1;
+  const RuleOrders& sorted = orders();
   for (size_t i = 0; i < num_dims; ++i) {
-    const size_t num_cuts = determine_number_of_cuts(i, spfac);
-    cut(i, num_cuts);
+    const CutEvaluator evaluator(box_, *table_, rule_set_.ids(),
+        sorted.by_start(i), sorted.by_end(i), i);
+    const size_t num_cuts = determine_number_of_cuts(evaluator, spfac);
     // find the child that contains most rules
-    size_t max_rules = 0;
-    const size_t num_children = children_.size();
-    for (size_t j = 0; j < num_children; ++j) {
-      const size_t num_rules = children_[j].rules().size();
-      max_rules = max_rules < num_rules ? num_rules : max_rules;
-    }
-    reset_cut();
+    const size_t max_rules = evaluator.max_rules_per_child(num_cuts);
     least_max_nodes[i] = max_rules;
     least_max = least_max > max_rules ? max_rules : least_max;
   }
@@ -164,7 +769,41 @@ size_t TreeNode::dim_least_max_rules_per_child(const size_t spfac) {
     if (least_max_nodes[i] == least_max)
       dims.push_back(i);
   delete[] least_max_nodes;
-  return dims[rand() % dims.size()];
+  return dims[rng_() % dims.size()];
+}
+
+
+size_t TreeNode::least_cost_cut(const size_t spfac, const size_t binth,
+    size_t& num_cuts) const {
+
+  const size_t num_dims = box_.num_dims();
+  const size_t num_rules = rule_set_.size();
+  const RuleOrders& sorted = orders();
+  size_t best_dim = 0;
+  num_cuts = 0;
+  double least_cost = 0;
+  for (size_t i = 0; i < num_dims; ++i) {
+    CutEvaluator evaluator(box_, *table_, rule_set_.ids(),
+        sorted.by_start(i), sorted.by_end(i), i);
+    if (packets_)
+      evaluator.set_packets(*packets_);
+    const size_t max_cuts = determine_number_of_cuts(evaluator, spfac);
+    size_t cuts = 1;
+    while (cuts <= max_cuts) {
+      const double cost = evaluator.expected_evaluations(cuts, binth);
+      // a cut that leaves a child with all rules does not make progress
+      const bool progress = evaluator.max_rules_per_child(cuts) < num_rules;
+      if (progress && (num_cuts == 0 || cost < least_cost)) {
+        best_dim = i;
+        num_cuts = cuts;
+        least_cost = cost;
+      }
+      if (cuts == max_cuts)
+        break;
+      cuts = min(2 * cuts + 1, max_cuts);
+    }
+  }
+  return best_dim;
 }
 
 
@@ -172,162 +811,292 @@ size_t TreeNode::dim_most_distinct_projection_points(
     std::vector<dim_t>& points) const {
 
   const size_t num_dims = box_.num_dims();
-  const size_t num_rules = rules_.size();
-  std::vector<std::set<dim_t>> point_sets;
+  const size_t num_rules = rule_set_.size();
+  const RuleOrders& sorted = orders();
+  std::vector<std::vector<dim_t>> point_lists(num_dims);
+  std::vector<dim_t> starts;
+  std::vector<dim_t> ends;
   size_t max_points = 0;
   for (size_t i = 0; i < num_dims; ++i) {
     const dim_t box_start = std::get<0>(box_.box_bounds()[i]);
     const dim_t box_end = std::get<1>(box_.box_bounds()[i]);
-    std::set<dim_t> points;
+    const PositionVector& by_start = sorted.by_start(i);
+    const PositionVector& by_end = sorted.by_end(i);
+    starts.clear();
+    ends.clear();
     for (size_t j = 0; j < num_rules; ++j) {
-      const dim_t start = std::get<0>(rules_[j]->box().box_bounds()[i]);
-      const dim_t end = std::get<1>(rules_[j]->box().box_bounds()[i]);
+      const dim_t start = table_->start(i, rule_set_.ids()[by_start[j]]);
+      const dim_t end = table_->end(i, rule_set_.ids()[by_end[j]]);
       if (start >= box_start)
-        points.insert(start);
+        starts.push_back(start);
       if (end <= box_end)
-        points.insert(end);
+        ends.push_back(end);
     }
-    const size_t num_points = points.size();
+    // both lists are sorted, so merging them yields the distinct points in
+    // ascending order
+    std::vector<dim_t>& dim_points = point_lists[i];
+    dim_points.resize(starts.size() + ends.size());
+    std::merge(starts.begin(), starts.end(), ends.begin(), ends.end(),
+        dim_points.begin());
+    dim_points.erase(std::unique(dim_points.begin(), dim_points.end()),
+        dim_points.end());
+    const size_t num_points = dim_points.size();
     max_points = num_points > max_points ? num_points : max_points;
-    point_sets.push_back(points);
   }
   // find those dimensions with the maximum number of distinct points
   std::vector<size_t> max_dims;
   for (size_t i = 0; i < num_dims; ++i)
-    if (point_sets[i].size() == max_points)
+    if (point_lists[i].size() == max_points)
       max_dims.push_back(i);
   // randomly select one of these
-  const size_t max_dim = max_dims[rand() % max_dims.size()];
-  std::set<dim_t>& target_set = point_sets[max_dim];
-  for (auto it = target_set.begin(); it != target_set.end(); ++it)
-    points.push_back(*it);
+  const size_t max_dim = max_dims[rng_() % max_dims.size()];
+  const std::vector<dim_t>& target_points = point_lists[max_dim];
+  points.insert(points.end(), target_points.begin(), target_points.end());
   return max_dim;
 }
 
 
+void TreeNode::expand(const size_t spfac, const size_t binth,
+    const size_t dim_choice, const size_t cut_algo,
+    const bool compact_regions) {
+
+  size_t cut_dim = 0;
+  std::vector<PositionVector> child_positions;
+  std::vector<size_t> hyper_dims;
+  std::vector<size_t> hyper_num_cuts;
+  size_t split_dim = 0;
+  dim_t split_point = 0;
+  if (cut_algo == Arguments::CUT_ALGO_HYPERCUTS)
+    determine_hyper_cuts(spfac, hyper_dims, hyper_num_cuts);
+  // perform the cut
+  if (!hyper_dims.empty())
+    hyper_cut(hyper_dims, hyper_num_cuts, &child_positions);
+  else if (cut_algo == Arguments::CUT_ALGO_HYPERSPLIT
+      && best_split(split_dim, split_point))
+    split(split_dim, split_point, &child_positions);
+  else if (cut_algo != Arguments::CUT_ALGO_UNEQUAL) {
+    // equidistant cut, also taken by HyperCuts and HyperSplit if no dimension
+    // can be cut
+    size_t num_cuts = 0;
+    if (dim_choice == Arguments::DIM_CHOICE_LEAST_MAX_RULES)
+      cut_dim = dim_least_max_rules_per_child(spfac);
+    else if (dim_choice == Arguments::DIM_CHOICE_COST)
+      cut_dim = least_cost_cut(spfac, binth, num_cuts);
+    // the cost model falls back to the default if no cut makes progress
+    if (dim_choice != Arguments::DIM_CHOICE_LEAST_MAX_RULES
+        && num_cuts == 0) {
+      std::tuple<size_t, bool> distinct(dim_max_distinct_rules());
+      const bool have_distinct_dim = std::get<1>(distinct);
+      if (have_distinct_dim)
+        // if we have a dimension with distinct rules, take it
+        cut_dim = std::get<0>(distinct);
+      else {
+        // otherwise, try to find the dimension with most distinct projection
+        // points
+        std::vector<dim_t> unused;
+        cut_dim = dim_most_distinct_projection_points(unused);
+      }
+    }
+    if (num_cuts == 0)
+      num_cuts = determine_number_of_cuts(cut_dim, spfac);
+    cut(cut_dim, num_cuts, &child_positions);
+  } else {
+    // unequal cut
+    std::tuple<size_t, bool> distinct(dim_max_distinct_rules());
+    cut_dim = std::get<0>(distinct);
+    std::vector<dim_t> cut_points;
+    std::vector<DimTuple> intervals;
+    orders().sorted_intervals(cut_dim, *table_, rule_set_.ids(), intervals);
+    Rule::sorted_interval_cut_points(intervals, cut_points);
+    unequal_cut(cut_dim, cut_points, &child_positions);
+    // check whether we have to cut on projection points (if there were no
+    // distinct rules)
+    if (!has_been_cut()) {
+      std::vector<dim_t> projection_points;
+      cut_dim = dim_most_distinct_projection_points(projection_points);
+      unequal_cut(cut_dim, projection_points, &child_positions);
+      // if the node still has not been cut yet, perform an equidistant cut
+      if (!has_been_cut()) {
+        const size_t num_cuts = determine_number_of_cuts(cut_dim, spfac);
+        cut(cut_dim, num_cuts, &child_positions);
+      }
+    }
+  }
+
+  // seed the children's generators by their path, so the shape of their
+  // subtrees does not depend on which worker expands them, nor on the ties
+  // broken at this node
+  for (size_t i = 0; i < num_children_; ++i)
+    child(i).seed_rng(TreeNode::child_seed(seed_, i));
+  push_common_rules(child_positions);
+  if (compact_regions)
+    compact_child_regions();
+  pass_packets_to_children(binth);
+  pass_orders_to_children(child_positions, binth);
+  const size_t table_size = table_->size();
+  for (size_t i = 0; i < num_children_; ++i)
+    if (child(i).num_rules() <= binth)
+      child(i).rule_set_.compact(table_size);
+  rule_set_.compact(table_size);
+}
+
+
+const RuleOrders& TreeNode::orders() const {
+  if (!orders_)
+    orders_.reset(new RuleOrders(*table_, rule_set_.ids(), box_.num_dims()));
+  return *orders_;
+}
+
+
+void TreeNode::pass_orders_to_children(
+    const std::vector<PositionVector>& child_positions,
+    const size_t min_rules) {
+
+  // children whose positions are unknown sort their rules themselves
+  if (child_positions.size() != num_children_) {
+    orders_.reset();
+    return;
+  }
+  // children that stay leaves never look at their orderings
+  std::vector<RuleOrders*> child_orders(num_children_, nullptr);
+  bool have_inner_child = false;
+  for (size_t i = 0; i < num_children_; ++i) {
+    TreeNode& node = child(i);
+    if (node.num_rules() <= min_rules)
+      continue;
+    node.orders_.reset(new RuleOrders(box_.num_dims()));
+    child_orders[i] = node.orders_.get();
+    have_inner_child = true;
+  }
+  if (have_inner_child)
+    orders().derive(child_positions, child_orders);
+  orders_.reset();
+}
+
+
+void TreeNode::pass_packets_to_children(const size_t min_rules) {
+  if (!packets_)
+    return;
+  // the children of a cut along a single dimension are ordered along it
+  const bool ordered = __builtin_popcount(cut_dims_) == 1;
+  const size_t num_packets = packets_->size();
+  for (size_t i = 0; i < num_packets; ++i) {
+    size_t lo = 0;
+    size_t hi = num_children_;
+    if (ordered) {
+      // find the last child that starts at or before the packet
+      const dim_t value = packets_->coordinate(i, cut_dim_);
+      while (hi - lo > 1) {
+        const size_t mid = (lo + hi) >> 1;
+        if (std::get<0>(child(mid).box_.box_bounds()[cut_dim_]) <= value)
+          lo = mid;
+        else
+          hi = mid;
+      }
+    }
+    for (size_t k = lo; k < hi; ++k) {
+      TreeNode& target = child(k);
+      if (!packets_->inside(i, target.box_))
+        continue;
+      target.packet_weight_ += packets_->weight(i);
+      if (target.num_rules() > min_rules) {
+        if (!target.packets_)
+          target.packets_.reset(new PacketSet());
+        target.packets_->add(*packets_, i);
+      }
+      break;
+    }
+  }
+  packets_.reset();
+}
+
+
+void TreeNode::set_packets(const PacketSet& packets) {
+  packets_.reset(new PacketSet());
+  const size_t num_packets = packets.size();
+  for (size_t i = 0; i < num_packets; ++i)
+    if (packets.inside(i, box_))
+      packets_->add(packets, i);
+  packet_weight_ = packets_->total_weight();
+}
+
+
 void TreeNode::build_tree(const size_t spfac, const size_t binth,
-    const size_t dim_choice, const size_t cut_algo) {
+    const size_t dim_choice, const size_t cut_algo, const size_t jobs,
+    const bool compact_regions) {
 
+  // expand the tree breadth-first; with several workers, stop as soon as the
+  // frontier offers enough independent subtrees to keep all of them busy
+  const size_t max_frontier = jobs * TreeNode::FRONTIER_PER_JOB;
+  // a leaf only keeps the number of its packets
+  if (num_rules() <= binth)
+    packets_.reset();
   NodeRefQueue fifo;
   fifo.push(this);
-  size_t cut_dim = 0;
-  while (!fifo.empty()) {
+  while (!fifo.empty() && (jobs <= 1 || fifo.size() < max_frontier)) {
     TreeNode* node = fifo.front();
     fifo.pop();
     if (node->num_rules() <= binth)
       continue;
-    // perform the cut
-    if (cut_algo == Arguments::CUT_ALGO_EQUIDISTANT) {
-      // equidistant cut
-      if (dim_choice == Arguments::DIM_CHOICE_LEAST_MAX_RULES)
-        cut_dim = node->dim_least_max_rules_per_child(spfac);
-      else {
-        std::tuple<size_t, bool> distinct(node->dim_max_distinct_rules());
-        const bool have_distinct_dim = std::get<1>(distinct);
-        if (have_distinct_dim)
-          // if we have a dimension with distinct rules, take it
-          cut_dim = std::get<0>(distinct);
-        else {
-          // otherwise, try to find the dimension with most distinct projection
-          // points
-          std::vector<dim_t> unused;
-          cut_dim = node->dim_most_distinct_projection_points(unused);
-        }
-        ////////std::cout << "have distinct dim = " << have_distinct_dim << std::endl;
-        ////////std::cout << "cut dim = " << cut_dim << std::endl;
-      }
-      const size_t num_cuts = node->determine_number_of_cuts(cut_dim, spfac);
-      node->cut(cut_dim, num_cuts);
-    } else {
-      // unequal cut
-      std::tuple<size_t, bool> distinct(node->dim_max_distinct_rules());
-      cut_dim = std::get<0>(distinct);
-      ///////////cut_dim = node->dim_max_distinct_rules();
-      ////std::cout << "cut dim (distinct): " << cut_dim << std::endl;
-      std::vector<dim_t> cut_points;
-      std::vector<const Rule*> rules_copy(node->rules());
-      ////std::cout << "num cut points before computation: " << cut_points.size() << std::endl;
-      Rule::cut_points(cut_dim, rules_copy, cut_points);
-      ////std::cout << "cut points = ";
-      ////for (size_t i = 0; i < cut_points.size(); ++i)
-      ////  std::cout << cut_points[i] << " ";
-      ////std::cout << std::endl;
-      node->unequal_cut(cut_dim, cut_points);
-      ////std::cout << "cut dim (distinct) = " << cut_dim << std::endl;
-      ////std::cout << "has been cut (distinct) = " << node->has_been_cut() << std::endl;
-      // check whether we have to cut on projection points (if there were no
-      // distinct rules)
-      if (!node->has_been_cut()) {
-        std::vector<dim_t> projection_points;
-        cut_dim = node->dim_most_distinct_projection_points(projection_points);
-        ////std::cout << "num proj. points = " << projection_points.size() << std::endl;
-        ////std::cout << "cut dim (proj.) = " << cut_dim << std::endl;
-        node->unequal_cut(cut_dim, projection_points);
-        ////std::cout << "has been cut (proj.) = " << node->has_been_cut() << std::endl;
-        ////std::cout << "Proj. points = ";
-        ////for (auto it = projection_points.begin(); it != projection_points.end(); ++it)
-        ////  std::cout << *it << " ";
-        ////std::cout << std::endl;
-        // if the node still has not been cut yet, perform an equidistant cut
-        if (!node->has_been_cut()) {
-          const size_t num_cuts = node->determine_number_of_cuts(cut_dim, spfac);
-          ////std::cout << "num cuts = " << num_cuts << std::endl;
-          node->cut(cut_dim, num_cuts);
-        }
-      }
-    }
+    node->expand(spfac, binth, dim_choice, cut_algo, compact_regions);
     // add children to the tree if they are large enough
-    NodeVector& children = node->children();
-    const size_t num_children = children.size();
-    //std::cout << "num children = " << num_children << std::endl;
-
-    ///bool all_same_size = true;
-    ///for (size_t i = 0; i < num_children; ++i) {
-    ///  if (children[i].num_rules() != node->num_rules()) {
-    ///    all_same_size = false;
-    ///    break;
-    ///  }
-    ///}
-    ///std::cout << "all same size = " << all_same_size << std::endl;
-    ///if (all_same_size) {
-    ///////////std::cout << "Node: [" << std::get<0>(node->box().box_bounds()[cut_dim])
-    ///////////    << ", " << std::get<1>(node->box().box_bounds()[cut_dim]) << "]"
-    ///////////    << std::endl;
-    ///////////std::cout << "Rules: ";
-    ///////////const std::vector<const Rule*>& rules = node->rules();
-    ///////////const size_t num_dims = node->box().box_bounds().size();
-    ///////////for (size_t j = 0; j < num_dims; ++j) {
-    ///////////  std::cout << "- ";
-    ///////////  if (j == cut_dim)
-    ///////////    std::cout << "CUT DIM";
-    ///////////  std::cout << " -\n";
-    ///////////  for (size_t i = 0; i < rules.size(); ++i) {
-    ///////////    std::cout << "[" << std::get<0>(rules[i]->box().box_bounds()[j])
-    ///////////        << ", " << std::get<1>(rules[i]->box().box_bounds()[j])
-    ///////////        << "] ";
-    ///////////  }
-    ///////////  std::cout << std::endl;
-    ///////////}
-    ///////////std::cout << "Children spans in cut dim: ";
-    ///////////for (size_t i = 0; i < num_children; ++i) {
-    ///////////  std::cout << "[" << std::get<0>(children[i].box().box_bounds()[cut_dim])
-    ///////////      << ", " << std::get<1>(children[i].box().box_bounds()[cut_dim])
-    ///////////      << "] ";
-    ///////////}
-    ///////////std::cout << std::endl;
-    ///}
-
-    //////std::cout << "Child rule sizes:" << std::endl;
+    const size_t num_children = node->num_children();
     for (size_t i = 0; i < num_children; ++i) {
-      TreeNode& child = children[i];
-      ///////std::cout << child.rules().size() << " ";
+      TreeNode& child = node->child(i);
       if (child.num_rules() > binth)
         fifo.push(&child);
     }
-    //////std::cout << std::endl << "fifo size = " << fifo.size() << std::endl;
-    //////std::cout << "----------------------" <<  std::endl;
-    //////std::this_thread::sleep_for(std::chrono::milliseconds(1000));
   }
+  if (!fifo.empty())
+    build_subtrees(fifo, spfac, binth, dim_choice, cut_algo, jobs,
+        compact_regions);
+}
+
+
+void TreeNode::build_subtrees(NodeRefQueue& frontier, const size_t spfac,
+    const size_t binth, const size_t dim_choice, const size_t cut_algo,
+    const size_t jobs, const bool compact_regions) {
+
+  // deal the frontier out round-robin; every worker then expands its own
+  // subtrees depth-first and steals the oldest node of another worker once
+  // its deque runs dry
+  std::vector<StealingDeque<TreeNode*>> deques(jobs);
+  std::atomic<size_t> pending(frontier.size());
+  std::atomic<bool> aborted(false);
+  for (size_t i = 0; !frontier.empty(); ++i) {
+    deques[i % jobs].push(frontier.front());
+    frontier.pop();
+  }
+  const WorkerPool pool(jobs);
+  pool.run(jobs, [&] (const size_t worker) {
+    StealingDeque<TreeNode*>& own = deques[worker];
+    TreeNode* node = nullptr;
+    while (pending.load() > 0 && !aborted.load()) {
+      bool have_node = own.pop(node);
+      for (size_t i = 1; i < jobs && !have_node; ++i)
+        have_node = deques[(worker + i) % jobs].steal(node);
+      if (!have_node) {
+        std::this_thread::yield();
+        continue;
+      }
+      try {
+        node->expand(spfac, binth, dim_choice, cut_algo, compact_regions);
+      } catch (...) {
+        aborted.store(true);
+        throw;
+      }
+      const size_t num_children = node->num_children();
+      for (size_t i = 0; i < num_children; ++i) {
+        TreeNode& child = node->child(i);
+        if (child.num_rules() > binth) {
+          ++pending;
+          own.push(&child);
+        }
+      }
+      // only retire the node after its children have been accounted for
+      --pending;
+    }
+  });
 }
 
 
@@ -356,21 +1125,18 @@ Box TreeNode::minimal_bounding_box(const RuleVector& rules,
 }
 
 
-Box TreeNode::minimal_bounding_box(const NodeVector& nodes,
-    const DomainTuple& domain) {
-
-  const size_t num_nodes = nodes.size();
+Box TreeNode::children_bounding_box(const DomainTuple& domain) const {
   DimVector dims;
-  if (num_nodes == 0)
+  if (num_children_ == 0)
     return Box(dims);
-  const size_t num_dims = nodes[0].box().num_dims();
+  const size_t num_dims = child(0).box().num_dims();
   for (size_t i = 0; i < num_dims; ++i) {
     dim_t min = max_ip;
     dim_t max = min_ip;
     const size_t start = std::get<0>(domain);
     const size_t end = std::get<1>(domain);
     for (size_t j = start; j <= end; ++j) {
-      const DimVector& dims = nodes[j].box().box_bounds();
+      const DimVector& dims = child(j).box().box_bounds();
       const DimTuple& dim_tuple = dims[i];
       min = min < std::get<0>(dim_tuple) ? min : std::get<0>(dim_tuple);
       max = max > std::get<1>(dim_tuple) ? max : std::get<1>(dim_tuple);
@@ -381,8 +1147,39 @@ Box TreeNode::minimal_bounding_box(const NodeVector& nodes,
 }
 
 
+/*
+ * Scrambles state with the splitmix64 generator's step and finalizer.
+ */
+static uint64_t splitmix(uint64_t state) {
+  state += 0x9E3779B97F4A7C15ULL;
+  state = (state ^ (state >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  state = (state ^ (state >> 27)) * 0x94D049BB133111EBULL;
+  return state ^ (state >> 31);
+}
+
+
+size_t TreeNode::tree_seed(const size_t seed, const size_t chain_id,
+    const size_t tree_id) {
+
+  // scramble each component in turn
+  uint64_t state = splitmix(seed);
+  state = splitmix(state ^ chain_id);
+  return splitmix(state ^ tree_id);
+}
+
+
+size_t TreeNode::child_seed(const size_t parent_seed,
+    const size_t child_index) {
+
+  return splitmix(parent_seed ^ splitmix(child_index));
+}
+
+
 std::string TreeNode::prot() const {
-  return rules_[0]->protocol() == TCP ? "tcp" : "udp";
+  // children may have passed all their rules on to their parent, but all
+  // rules of a tree share their protocol
+  const Rule* first = num_rules() > 0 ? rule(0) : table_->rule(0);
+  return first->protocol() == TCP ? "tcp" : "udp";
 }
 
 
@@ -394,18 +1191,133 @@ void TreeNode::compute_numbering() {
     TreeNode* current_node = node_stack.top();
     node_stack.pop();
     current_node->set_id(current_id++);
-    NodeVector& children = current_node->children();
-    const size_t num_children = children.size();
+    const size_t num_children = current_node->num_children();
+    for (int i = num_children - 1; i >= 0; --i)
+      node_stack.push(&current_node->child(i));
+  }
+}
+
+
+void TreeNode::share_leaf_ids() {
+  std::unordered_multimap<size_t, const TreeNode*> leaves;
+  NodeRefStack node_stack;
+  node_stack.push(this);
+  while (!node_stack.empty()) {
+    TreeNode* current_node = node_stack.top();
+    node_stack.pop();
+    const size_t num_children = current_node->num_children();
     for (int i = num_children - 1; i >= 0; --i)
-      node_stack.push(&children[i]);
+      node_stack.push(&current_node->child(i));
+    if (num_children > 0)
+      continue;
+    const size_t hash = current_node->rule_set_.hash();
+    const auto range = leaves.equal_range(hash);
+    auto it = range.first;
+    while (it != range.second
+        && it->second->rule_set_ != current_node->rule_set_)
+      ++it;
+    if (it != range.second)
+      current_node->set_id(it->second->id());
+    else
+      leaves.insert(std::make_pair(hash, current_node));
   }
 }
 
 
-void TreeNode::add_rule(const Rule* rule) {
-  const size_t num_rules_ = num_rules();
-  for (size_t i = 0; i < num_rules_; ++i)
-    if (rule->is_shadowed(rules_[i], box_))
-      return;
-  rules_.push_back(rule);
+double TreeNode::expected_evaluations() const {
+  double evaluations = 0;
+  std::stack<std::tuple<const TreeNode*, double>> node_stack;
+  node_stack.push(std::make_tuple(this, 1.0));
+  while (!node_stack.empty()) {
+    const TreeNode* current_node = std::get<0>(node_stack.top());
+    const double share = std::get<1>(node_stack.top());
+    node_stack.pop();
+    const size_t num_children = current_node->num_children();
+    if (num_children == 0) {
+      evaluations += share * (current_node->num_rules() + 1);
+      continue;
+    }
+    evaluations += share * (current_node->pushed_ids_.size()
+        + CutEvaluator::dispatch_evaluations(num_children));
+    const DimVector& bounds = current_node->box_.box_bounds();
+    for (size_t i = 0; i < num_children; ++i) {
+      const TreeNode& child = current_node->child(i);
+      if (packet_weight_ > 0) {
+        node_stack.push(std::make_tuple(&child,
+            double(child.packet_weight_) / packet_weight_));
+        continue;
+      }
+      const DimVector& child_bounds = child.box_.box_bounds();
+      double child_share = share;
+      for (size_t dim = 0; dim < bounds.size(); ++dim) {
+        const double child_width = double(std::get<1>(child_bounds[dim]))
+            - std::get<0>(child_bounds[dim]) + 1;
+        const double width = double(std::get<1>(bounds[dim]))
+            - std::get<0>(bounds[dim]) + 1;
+        child_share *= child_width / width;
+      }
+      node_stack.push(std::make_tuple(&child, child_share));
+    }
+  }
+  return evaluations;
+}
+
+
+TreeNode& TreeNode::add_child(const Box& box) {
+  NodeVector children;
+  for (size_t i = 0; i < num_children_; ++i)
+    children.push_back(std::move(child(i)));
+  children.push_back(TreeNode(box, table_, arena_));
+  attach_children(children);
+  return child(num_children_ - 1);
+}
+
+
+bool TreeNode::add_rule(const Rule* rule) {
+  return add_rule_id(table_->add(rule));
+}
+
+
+bool TreeNode::add_rule_id(const uint32_t id) {
+  rule_set_.to_list();
+  if (shadow_index_) {
+    if (shadow_index_->shadowed(id))
+      return false;
+    shadow_index_->insert(id);
+  } else {
+    const TableBox frame(box_);
+    const size_t num_rules_ = num_rules();
+    for (size_t i = 0; i < num_rules_; ++i)
+      if (table_->is_shadowed(id, rule_set_.ids()[i], frame))
+        return false;
+    if (num_rules_ + 1 == SHADOW_INDEX_MIN_RULES) {
+      shadow_index_.reset(new ShadowIndex(*table_, frame));
+      for (size_t i = 0; i < num_rules_; ++i)
+        shadow_index_->insert(rule_set_.ids()[i]);
+      shadow_index_->insert(id);
+    }
+  }
+  rule_set_.push_back(id);
+  orders_.reset();
+  return true;
+}
+
+
+std::vector<const Rule*> TreeNode::pushed_rules() const {
+  std::vector<const Rule*> rules;
+  rules.reserve(pushed_ids_.size());
+  for (size_t i = 0; i < pushed_ids_.size(); ++i)
+    rules.push_back(table_->rule(pushed_ids_[i]));
+  return rules;
+}
+
+
+std::vector<const Rule*> TreeNode::rules() const {
+  RuleIdVector ids;
+  rule_set_.collect(ids);
+  std::vector<const Rule*> rules;
+  rules.reserve(ids.size());
+  for (size_t i = 0; i < ids.size(); ++i)
+    rules.push_back(table_->rule(ids[i]));
+  return rules;
 }
@@ -7,24 +7,155 @@
 #include <stack>
 #include <set>
 #include <cmath>
+#include <random>
+#include <memory>
+#include <mutex>
 #include "rule.hpp"
 #include "arg.hpp"
+#include "ruletable.hpp"
+#include "cuteval.hpp"
+#include "collide.hpp"
+#include "shadow.hpp"
+#include "ruleset.hpp"
 
 class TreeNode;
+class NodeArena;
 typedef std::stack<TreeNode*> NodeRefStack;
 typedef std::queue<TreeNode*> NodeRefQueue;
 typedef std::vector<TreeNode> NodeVector;
 typedef std::vector<TreeNode*> NodeRefVector;
+typedef std::minstd_rand NodeRng;
+
+/*
+ * The positions of a node's rules sorted by interval start and by interval
+ * end point, one ordering of each kind per dimension.  Only the root of a
+ * tree sorts; the children derive their orderings from their parent's by
+ * stable filtering.
+ */
+class RuleOrders {
+public:
+  /*
+   * Creates empty orderings to be filled by derive.
+   */
+  RuleOrders(const size_t num_dims) : by_start_(num_dims), by_end_(num_dims) {}
+
+  /*
+   * Sorts the positions of the given rules in every dimension.
+   */
+  RuleOrders(const RuleTable& table, const RuleIdVector& ids,
+      const size_t num_dims);
+
+  inline const PositionVector& by_start(const size_t dim) const {
+    return by_start_[dim];
+  }
+
+  inline const PositionVector& by_end(const size_t dim) const {
+    return by_end_[dim];
+  }
+
+  /*
+   * Stores the intervals of the given rules, which these orderings were made
+   * for, sorted by their start points in the given dimension.
+   */
+  inline void sorted_intervals(const size_t dim, const RuleTable& table,
+      const RuleIdVector& ids, std::vector<DimTuple>& intervals) const {
+    table.intervals(dim, ids, by_start_[dim], intervals);
+  }
+
+  /*
+   * Fills the orderings of a node's children from this node's orderings.
+   * child_positions[i] lists the positions of the rules of the i-th child in
+   * this node's rules in ascending order.  Children whose entry in
+   * child_orders is null are skipped.
+   */
+  void derive(const std::vector<PositionVector>& child_positions,
+      const std::vector<RuleOrders*>& child_orders) const;
+
+private:
+  std::vector<PositionVector> by_start_;
+  std::vector<PositionVector> by_end_;
+};
+
+
+/*
+ * Storage for the nodes of one tree.  Nodes are addressed by 32-bit indices
+ * and the children of a node occupy a contiguous index range.  The arena grows
+ * in blocks of doubling size, so allocating never moves existing nodes and
+ * indices stay valid while other threads keep allocating.  Nodes are only
+ * freed together with the arena.
+ */
+class NodeArena {
+public:
+  NodeArena();
+
+  ~NodeArena();
+
+  /*
+   * Moves the given nodes into a contiguous range of the arena.
+   * Returns the index of the first node of the range.
+   * This method may be called concurrently.
+   */
+  uint32_t add_range(NodeVector& nodes);
+
+  inline TreeNode& operator[](const uint32_t index);
+
+  inline const TreeNode& operator[](const uint32_t index) const;
+
+private:
+  static const size_t MIN_BLOCK_BITS = 6;
+  static const size_t NUM_BLOCKS = 33 - MIN_BLOCK_BITS;
+
+  TreeNode* blocks_[NUM_BLOCKS];
+  size_t size_;
+  std::mutex mutex_;
+
+  NodeArena(const NodeArena&) = delete;
+  NodeArena& operator=(const NodeArena&) = delete;
+
+  /*
+   * Block b holds 2^(b + MIN_BLOCK_BITS) nodes.
+   */
+  static inline size_t block_of(const uint32_t index) {
+    const unsigned long long j = (index >> MIN_BLOCK_BITS) + 1ULL;
+    return 63 - __builtin_clzll(j);
+  }
+
+  static inline size_t block_start(const size_t block) {
+    return ((1ULL << block) - 1) << MIN_BLOCK_BITS;
+  }
+};
+
 
 class TreeNode {
 
 public:
+  /*
+   * Constructors for root nodes.  A root node owns the arena that stores all
+   * nodes below it.
+   */
   TreeNode(const DimVector& bounds)
-      : box_(bounds), has_been_cut_(false), cut_dim_(0), id_(0),
-      num_cuts_(0), path_length_(0) {}
+      : box_(bounds), owned_table_(new RuleTable()),
+      table_(owned_table_.get()), owned_arena_(new NodeArena()),
+      arena_(owned_arena_.get()), first_child_(0), num_children_(0),
+      has_been_cut_(false), split_(false), cut_dim_(0), cut_dims_(0), id_(0),
+      num_cuts_(0), path_length_(0), packet_weight_(0), seed_(0) {}
+
+  TreeNode(const Box& box)
+      : box_(box), owned_table_(new RuleTable()), table_(owned_table_.get()),
+      owned_arena_(new NodeArena()), arena_(owned_arena_.get()),
+      first_child_(0), num_children_(0), has_been_cut_(false), split_(false),
+      cut_dim_(0), cut_dims_(0), id_(0), num_cuts_(0), path_length_(0),
+      packet_weight_(0), seed_(0) {}
 
-  TreeNode(const Box& box) : box_(box), has_been_cut_(false), cut_dim_(0),
-      id_(0), num_cuts_(0), path_length_(0) {}
+  /*
+   * Constructor for inner nodes, whose rules come from the given table and
+   * whose children go to the given arena.
+   */
+  TreeNode(const Box& box, RuleTable* table, NodeArena* arena)
+      : box_(box), table_(table), arena_(arena), first_child_(0),
+      num_children_(0), has_been_cut_(false), split_(false), cut_dim_(0),
+      cut_dims_(0), id_(0), num_cuts_(0), path_length_(0), packet_weight_(0),
+      seed_(0) {}
 
   /*
    * Standard constructor to build a tree node.  rules is a vector of rules,
@@ -35,28 +166,91 @@ public:
    */
   TreeNode(const RuleVector& rules, const DomainTuple& domain) :
       box_(TreeNode::minimal_bounding_box(rules, domain)),
-      has_been_cut_(false), cut_dim_(0), id_(0), num_cuts_(0),
-      path_length_(0) {
+      owned_table_(new RuleTable()), table_(owned_table_.get()),
+      owned_arena_(new NodeArena()), arena_(owned_arena_.get()),
+      first_child_(0), num_children_(0), has_been_cut_(false), split_(false),
+      cut_dim_(0), cut_dims_(0), id_(0), num_cuts_(0), path_length_(0),
+      packet_weight_(0), seed_(0) {
   
     const size_t start = std::get<0>(domain);
     const size_t end = std::get<1>(domain);
     for (size_t i = start; i <= end; ++i)
       add_rule(rules[i]);
+    release_shadow_index();
   }
 
+  TreeNode(TreeNode&& other) = default;
+
+  TreeNode& operator=(TreeNode&& other) = default;
+
+  ~TreeNode();
+
   /*
    * Cuts this node along the given dimension the specified number of times.
-   * The new resulting nodes are then stored in the children_ vector.
+   * The new resulting nodes are then moved into the tree's arena as one
+   * contiguous range of children.
    * Also, calling this method sets the cut_dim_ and num_cuts_ members.
+   * If child_positions is given, it receives for every child the positions of
+   * the child's rules in this node's rules.
    */
-  void cut(const dim_t dimension, const size_t num_cuts);
+  void cut(const dim_t dimension, const size_t num_cuts,
+      std::vector<PositionVector>* child_positions = nullptr);
  
   /*
    * Performs a non-equidistant cut along the specified dimension.
    * If there are no propper cut points specified, no cut is performed.
+   * child_positions is filled as in cut.
    */
   void unequal_cut(const dim_t dimension,
-      const std::vector<dim_t>& cut_points);
+      const std::vector<dim_t>& cut_points,
+      std::vector<PositionVector>* child_positions = nullptr);
+
+  /*
+   * Cuts this node along several dimensions at once, the i-th of the given
+   * ascending dimensions num_cuts[i] times, as in HyperCuts.  The children
+   * are the non-empty cells of the resulting grid, ordered lexicographically
+   * by their slices with the lowest dimension being the most significant.
+   * child_positions is filled as in cut.
+   */
+  void hyper_cut(const std::vector<size_t>& dimensions,
+      const std::vector<size_t>& num_cuts,
+      std::vector<PositionVector>* child_positions = nullptr);
+
+  /*
+   * Splits this node's box in two along the given dimension, behind the
+   * given point, as in HyperSplit.  The point must lie within the box and
+   * before its end.  child_positions is filled as in cut.
+   */
+  void split(const size_t dimension, const dim_t point,
+      std::vector<PositionVector>* child_positions = nullptr);
+
+  /*
+   * Finds the split that balances the rules best between the two halves:
+   * among all rule end points and the points just before rule start points
+   * within the box, it picks the one that minimizes the number of rules in
+   * the larger half, then the number of rules in both halves, over all
+   * dimensions.  Returns false if no rule boundary lies within the box.
+   */
+  bool best_split(size_t& dimension, dim_t& point) const;
+
+  /*
+   * Computes the space measure of a hyper cut without performing it: the
+   * number of rules over all cells plus the number of cells.
+   */
+  size_t hyper_space_measure(const std::vector<size_t>& dimensions,
+      const std::vector<size_t>& num_cuts) const;
+
+  /*
+   * Chooses the dimensions and numbers of cuts for a hyper cut.  As in
+   * HyperCuts, the dimensions are those whose number of unique rule
+   * intervals is at least the average over all dimensions.  Starting at a
+   * single cut per dimension, the numbers of cuts are doubled in turn for as
+   * long as the space measure stays below the HiCuts bound of spfac times the
+   * number of rules.  Leaves the vectors empty if the rules do not differ in
+   * any dimension that can be cut.
+   */
+  void determine_hyper_cuts(const size_t spfac,
+      std::vector<size_t>& dimensions, std::vector<size_t>& num_cuts) const;
 
   /*
    * Computes the space measure functionality as defined in the HiCuts paper.
@@ -65,11 +259,14 @@ public:
 
   /*
    * Reset the cut of the tree node in order to make it cuttable again.
+   * The discarded children stay in the arena until the tree is destroyed.
    */
   inline void reset_cut() {
-    children_.clear();
+    num_children_ = 0;
     has_been_cut_ = false;
+    split_ = false;
     num_cuts_ = 0;
+    rule_set_.to_list();
   }
 
   /*
@@ -77,16 +274,16 @@ public:
    * HiCuts paper.
    */
   inline size_t space_measure_upper_bound(const size_t spfac) const {
-    return spfac * rules_.size();
+    return spfac * rule_set_.size();
   }
 
   /*
    * Determines the number of cuts to perform along the specified dimension and
    * with regard to the spfac parameter.
-   * Although this is not a const method, it reverts all changes that are being
-   * done to the tree node object during its execution.
+   * Trial cuts are evaluated on rule counts only; no children are created.
    */
-  size_t determine_number_of_cuts(const size_t dimension, const size_t spfac);
+  size_t determine_number_of_cuts(const size_t dimension,
+      const size_t spfac) const;
 
   /*
    * Detects the dimension in which the tree node's rules differ the most.
@@ -99,10 +296,20 @@ public:
    * Finds the dimension that exhibits with the least number of rules in the
    * biggest child after a cutting process.
    * If there are several candidates, one of them is randomly picked.
-   * Although this is not a const method, it reverts all changes that are being
-   * done to the tree node object during its execution.
+   * Trial cuts are evaluated on rule counts only; no children are created.
+   */
+  size_t dim_least_max_rules_per_child(const size_t spfac) const;
+
+  /*
+   * Finds the dimension and number of cuts that minimize the expected number
+   * of rules a packet traverses in the emitted chains, trying 2^k - 1 cuts up
+   * to the number allowed by spfac in every dimension.  Only cuts that leave
+   * every child with fewer rules than this node are considered.  Ties go to
+   * the lower dimension and the fewer cuts.  Returns the dimension and
+   * leaves num_cuts at 0 if there is no such cut.
    */
-  size_t dim_least_max_rules_per_child(const size_t spfac);
+  size_t least_cost_cut(const size_t spfac, const size_t binth,
+      size_t& num_cuts) const;
 
   /*
    * Finds the dimension that provides the most distinct projection points of
@@ -115,7 +322,34 @@ public:
   /*
    * Selects a random dimension for cutting.
    */
-  inline size_t random_dim() const {return rand() % box_.num_dims();}
+  inline size_t random_dim() const {return rng_() % box_.num_dims();}
+
+  /*
+   * Seeds the generator used for breaking ties between cut dimensions.
+   * During tree construction, every child is seeded with child_seed of its
+   * parent's seed and its position, so the seed of a node only depends on
+   * the root's seed and the path to the node, and the shape of its subtree
+   * does not depend on the order in which nodes are expanded.
+   */
+  inline void seed_rng(const size_t seed) {
+    seed_ = seed;
+    rng_.seed(seed);
+  }
+
+  inline size_t seed() const {return seed_;}
+
+  /*
+   * Derives the root seed for the tree_id-th tree of the chain_id-th chain
+   * from the global random seed.
+   */
+  static size_t tree_seed(const size_t seed, const size_t chain_id,
+      const size_t tree_id);
+
+  /*
+   * Derives the seed of the child_index-th child of a node from the node's
+   * seed.
+   */
+  static size_t child_seed(const size_t parent_seed, const size_t child_index);
 
   /*
    * Builds a HiCuts tree with this node as tree root.
@@ -123,29 +357,113 @@ public:
    * tree, as described in the paper.
    * dim_choice is a parameter that selects the algorithm for the choice of the
    * cut dimension.
-   * cut_algo determines whether equidistant or unequal cuts are performed
-   * during tree construction.
+   * cut_algo determines whether equidistant, unequal or multi-dimensional
+   * HyperCuts cuts, or binary HyperSplit splits, are performed during tree
+   * construction.
+   * jobs is the number of worker threads that expand independent subtrees
+   * concurrently.  The resulting tree does not depend on it.
+   * compact_regions shrinks the children's boxes to their rules after every
+   * cut, see compact_child_regions.
    */
   void build_tree(const size_t spfac, const size_t binth,
-      const size_t dim_choice, const size_t cut_algo);
+      const size_t dim_choice, const size_t cut_algo, const size_t jobs = 1,
+      const bool compact_regions = false);
 
-  inline size_t num_rules() const {return rules_.size();}
+  inline size_t num_rules() const {return rule_set_.size();}
 
-  void add_rule(const Rule* rule);
+  /*
+   * Adds the given rule unless it is shadowed by one of the node's rules
+   * within the node's box.  Returns whether the rule has been added.
+   * Once the node holds SHADOW_INDEX_MIN_RULES rules, the check is answered
+   * by a ShadowIndex instead of comparing against every rule.
+   * The rule is appended to the tree's rule table, so this method must not
+   * be called while the tree is being built.
+   */
+  bool add_rule(const Rule* rule);
+
+  /*
+   * Frees the index that speeds up add_rule.  To be called once no more
+   * rules are going to be added; adding rules afterwards remains correct.
+   */
+  inline void release_shadow_index() {shadow_index_.reset();}
 
   inline const Box& box() const {return box_;}
 
-  inline std::vector<TreeNode>& children() {return children_;}
+  inline TreeNode& child(const size_t i);
+
+  inline const TreeNode& child(const size_t i) const;
+
+  inline size_t num_children() const {return num_children_;}
+
+  /*
+   * Collects the node's rules in order.
+   */
+  std::vector<const Rule*> rules() const;
+
+  /*
+   * Returns the i-th rule.  Takes time linear in the size of the rule table
+   * once the node's rule set has been compacted; use rules() to iterate.
+   */
+  inline const Rule* rule(const size_t i) const {
+    return table_->rule(rule_set_.at(i));
+  }
+
+  /*
+   * The ids of the node's rules in the tree's rule table.  Only available
+   * until the node's rule set has been compacted, see expand; throws an
+   * std::string afterwards.
+   */
+  inline const RuleIdVector& rule_ids() const {return rule_set_.ids();}
+
+  inline const RuleSet& rule_set() const {return rule_set_;}
+
+  /*
+   * The rules that have been pushed up from all children of this node, in
+   * order.  They are matched before dispatching to the children, see
+   * push_common_rules.
+   */
+  inline const RuleIdVector& pushed_rule_ids() const {return pushed_ids_;}
+
+  std::vector<const Rule*> pushed_rules() const;
 
-  inline size_t num_children() const {return children_.size();}
+  /*
+   * Removes the rules that every child holds from the children and keeps them
+   * at this node instead, as in HyperCuts.  child_positions lists the
+   * positions of the children's rules as filled by cut and is updated
+   * accordingly.  A rule is only pushed if no earlier rule that remains in the
+   * children overlaps it within this node's box with a different action, so
+   * matching the pushed rules first does not change the first match.
+   */
+  void push_common_rules(std::vector<PositionVector>& child_positions);
+
+  /*
+   * Shrinks the boxes of the children to the bounding box of their rules, as
+   * in HyperCuts, so that later cuts only split space that rules cover.
+   * Packets outside a child's box then match none of its rules, wherever the
+   * dispatch sends them.  The dimensions of a hyper cut keep their slices,
+   * as the multi-field dispatch relies on the cells forming a grid.
+   */
+  void compact_child_regions();
 
-  inline const std::vector<const Rule*> rules() const {return rules_;}
+  inline const RuleTable& rule_table() const {return *table_;}
 
   inline size_t cut_dim() const {return cut_dim_;}
 
-  inline const std::string& chain() const {return rules_[0]->chain();}
+  /*
+   * The dimensions of the node's cut as a bit mask.  A hyper cut sets one
+   * bit per dimension, and cut_dim is the lowest of them.
+   */
+  inline uint32_t cut_dims() const {return cut_dims_;}
+
+  /*
+   * Whether the node has been split in two at an arbitrary point, as in
+   * HyperSplit, rather than cut into equal or unequal slices.
+   */
+  inline bool is_split() const {return split_;}
+
+  inline const std::string& chain() const {return rule(0)->chain();}
 
-  inline bool is_leaf() const {return children_.empty();}
+  inline bool is_leaf() const {return num_children_ == 0;}
 
   std::string prot() const;
 
@@ -156,10 +474,11 @@ public:
   }
 
   /*
-   * Appends a child to the vector of children.
+   * Appends an empty child with the given box and returns it.  The existing
+   * children are moved to a new range of the arena.
    * This method is intended to be used only for debugging purposes.
    */
-  inline void add_child(const TreeNode& child) {children_.push_back(child);}
+  TreeNode& add_child(const Box& box);
 
   inline size_t id() const {return id_;}
 
@@ -170,6 +489,37 @@ public:
    */
   void compute_numbering();
 
+  /*
+   * Gives all leaves with the same rules the id of the first of them, so
+   * that they share one chain.  Leaves are told apart by a hash of their
+   * rules.  To be called after compute_numbering.
+   */
+  void share_leaf_ids();
+
+  /*
+   * Estimates the number of rules a packet traverses in the chains emitted
+   * for the tree with this node as root, assuming packets spread evenly over
+   * the root's box: every node reached costs its pushed rules and the
+   * dispatch to its children, or its rules and the fall-through jump if it is
+   * a leaf.  A child is reached with the share of its parent's volume that
+   * its box covers, or with the share of its parent's observed packets if
+   * the tree has been given any.
+   */
+  double expected_evaluations() const;
+
+  /*
+   * Hands the observed packets inside this node's box to the node.  They
+   * weight the cut decisions of --dim-choice cost and the estimate of
+   * expected_evaluations, and are passed on to the children while the tree
+   * is built.  To be called on the root before build_tree.
+   */
+  void set_packets(const PacketSet& packets);
+
+  /*
+   * Number of observed packets inside this node's box.
+   */
+  inline size_t packet_weight() const {return packet_weight_;}
+
   /*
    * Computes the minimal bounding box around the rules specified by domain.
    */
@@ -177,23 +527,148 @@ public:
       const DomainTuple& domain);
 
   /*
-   * Computes the minimal bounding box around the tree nodes specified by
-   * domain.
+   * Computes the minimal bounding box around the children of this node
+   * specified by domain.
    */
-  static Box minimal_bounding_box(const NodeVector& rules,
-      const DomainTuple& domain);
+  Box children_bounding_box(const DomainTuple& domain) const;
 
   inline bool has_been_cut() const {return has_been_cut_;}
 
 private:
   Box box_;
-  std::vector<const Rule*> rules_;
-  std::vector<TreeNode> children_;
+  RuleSet rule_set_;
+  RuleIdVector pushed_ids_;
+  std::unique_ptr<RuleTable> owned_table_;
+  RuleTable* table_;
+  std::unique_ptr<NodeArena> owned_arena_;
+  NodeArena* arena_;
+  uint32_t first_child_;
+  uint32_t num_children_;
   bool has_been_cut_;
+  bool split_;
   size_t cut_dim_;
+  uint32_t cut_dims_;
   size_t id_;
   size_t num_cuts_;
   size_t path_length_;
+  size_t packet_weight_;
+  size_t seed_;
+  mutable NodeRng rng_;
+  mutable std::unique_ptr<RuleOrders> orders_;
+  std::unique_ptr<ShadowIndex> shadow_index_;
+  // the observed packets inside the box, kept until the node is expanded
+  std::unique_ptr<PacketSet> packets_;
+
+  /*
+   * Number of frontier nodes per worker at which build_tree switches from
+   * breadth-first expansion to work stealing.
+   */
+  static const size_t FRONTIER_PER_JOB = 4;
+
+  /*
+   * Number of rules from which on add_rule builds a ShadowIndex.  Below, a
+   * linear scan is faster.
+   */
+  static const size_t SHADOW_INDEX_MIN_RULES = 32;
+
+  /*
+   * Number of children from which on build_children sweeps over the cut
+   * dimension instead of colliding every child with every rule.
+   */
+  static const size_t SWEEP_MIN_CHILDREN = 4;
+
+  /*
+   * Adds the rule with the given id in the tree's rule table, as add_rule.
+   */
+  bool add_rule_id(const uint32_t id);
+
+  /*
+   * Lists for every one of the given slices of the cut dimension the
+   * positions of this node's rules that collide with the corresponding piece
+   * of this node's box, by locating each rule's interval among the slices.
+   * Returns false without listing anything unless the slices are ascending
+   * and leave no gaps.
+   */
+  bool sweep_children(const size_t dimension, const DimVector& slices,
+      std::vector<PositionVector>& candidates) const;
+
+  /*
+   * Builds up a child with the given box from the given ascending positions
+   * of this node's rules that collide with it.  The child is appended to
+   * children unless no rule is added.
+   */
+  void build_child(const Box& box, const PositionVector& colliding,
+      NodeVector& children,
+      std::vector<PositionVector>* child_positions) const;
+
+  /*
+   * Builds up a child for each piece of this node's box with one of the
+   * given slices of the cut dimension that receives at least one of this
+   * node's rules.  Only these children's boxes are created.
+   */
+  void build_children(const size_t dimension, const DimVector& slices,
+      NodeVector& children,
+      std::vector<PositionVector>* child_positions) const;
+
+  /*
+   * Cuts this node's rules into the given vector of children without
+   * attaching them to the tree.
+   */
+  void trial_cut(const dim_t dimension, const size_t num_cuts,
+      NodeVector& children,
+      std::vector<PositionVector>* child_positions) const;
+
+  /*
+   * Returns the sorted orderings of this node's rules.  They are derived
+   * from the parent's during expansion, or sorted here for a root.
+   */
+  const RuleOrders& orders() const;
+
+  /*
+   * Derives the orderings of all children that hold more than min_rules
+   * rules and releases this node's orderings.  Without positions for every
+   * child, the children sort their rules themselves.
+   */
+  void pass_orders_to_children(
+      const std::vector<PositionVector>& child_positions,
+      const size_t min_rules);
+
+  /*
+   * Sums up the observed packets of every child, hands the packets on to the
+   * children that hold more than min_rules rules and releases this node's
+   * packets.  Packets outside all children are dropped.
+   */
+  void pass_packets_to_children(const size_t min_rules);
+
+  /*
+   * Moves the given children into the arena and makes them the children of
+   * this node.
+   */
+  void attach_children(NodeVector& children);
+
+  /*
+   * Determines the number of cuts along the evaluator's dimension.
+   */
+  size_t determine_number_of_cuts(const CutEvaluator& evaluator,
+      const size_t spfac) const;
+
+  /*
+   * Cuts this node according to the given parameters and seeds the
+   * generators of the resulting children.  Children with more than binth
+   * rules inherit the sorted orderings of their rules.  The rule sets of this
+   * node and of the children that become leaves are compacted afterwards, as
+   * their rules are no longer accessed by position.
+   */
+  void expand(const size_t spfac, const size_t binth, const size_t dim_choice,
+      const size_t cut_algo, const bool compact_regions = false);
+
+  /*
+   * Expands the subtrees below the given frontier nodes on jobs workers with
+   * per-worker deques and work stealing.
+   */
+  void build_subtrees(NodeRefQueue& frontier, const size_t spfac,
+      const size_t binth, const size_t dim_choice, const size_t cut_algo,
+      const size_t jobs, const bool compact_regions);
 
   inline size_t max(const size_t a, const size_t b) const {
     return a > b ? a : b;
@@ -204,4 +679,26 @@ private:
   }
 };
 
+
+inline TreeNode& NodeArena::operator[](const uint32_t index) {
+  const size_t block = block_of(index);
+  return blocks_[block][index - block_start(block)];
+}
+
+
+inline const TreeNode& NodeArena::operator[](const uint32_t index) const {
+  const size_t block = block_of(index);
+  return blocks_[block][index - block_start(block)];
+}
+
+
+inline TreeNode& TreeNode::child(const size_t i) {
+  return (*arena_)[first_child_ + i];
+}
+
+
+inline const TreeNode& TreeNode::child(const size_t i) const {
+  return (*arena_)[first_child_ + i];
+}
+
 #endif // HITABLES_TREENODE_HPP
@@ -0,0 +1,198 @@
+#include "tune.hpp"
+#include "emit.hpp"
+#include "pool.hpp"
+
+void tune::build_trees(const ChainVector& chains,
+    const std::vector<DomainVector>& chain_domains, const Arguments& args,
+    const PacketSet& packets, const size_t jobs,
+    std::vector<NodeRefVector>& chain_trees) {
+
+  // every (chain, sub-ruleset) pair yields an independent tree, so the trees
+  // are built concurrently; each tree draws its tie-breaking decisions from
+  // its own generator, which keeps the output independent of --jobs
+  const size_t num_chains = chains.size();
+  chain_trees.assign(num_chains, NodeRefVector());
+  std::vector<std::tuple<size_t, size_t>> tree_jobs;
+  for (size_t i_chain = 0; i_chain < num_chains; ++i_chain) {
+    const size_t num_chain_domains = chain_domains[i_chain].size();
+    chain_trees[i_chain].resize(num_chain_domains, nullptr);
+    for (size_t i = 0; i < num_chain_domains; ++i)
+      tree_jobs.push_back(std::make_tuple(i_chain, i));
+  }
+  // start with the largest sub-rulesets to keep the workers busy
+  std::stable_sort(tree_jobs.begin(), tree_jobs.end(),
+      [&chain_domains] (const std::tuple<size_t, size_t>& a,
+                        const std::tuple<size_t, size_t>& b) {
+    const DomainTuple& da = chain_domains[std::get<0>(a)][std::get<1>(a)];
+    const DomainTuple& db = chain_domains[std::get<0>(b)][std::get<1>(b)];
+    return std::get<1>(da) - std::get<0>(da) >
+           std::get<1>(db) - std::get<0>(db);
+  });
+  const size_t dim_choice = args.dim_choice();
+  const size_t cut_algo = args.cut_algo();
+  // sub-rulesets holding more than a 1/jobs share of all rules would keep a
+  // single worker busy long after the others are done; these are built one
+  // after another with all workers expanding their subtrees, the rest are
+  // built concurrently with one worker each
+  size_t total_domain_rules = 0;
+  for (size_t i = 0; i < tree_jobs.size(); ++i) {
+    const DomainTuple& domain = chain_domains[std::get<0>(tree_jobs[i])][
+        std::get<1>(tree_jobs[i])];
+    total_domain_rules += std::get<1>(domain) - std::get<0>(domain) + 1;
+  }
+  auto build = [&] (const size_t job, const size_t num_workers) {
+    const size_t i_chain = std::get<0>(tree_jobs[job]);
+    const size_t i = std::get<1>(tree_jobs[job]);
+    const DomainTuple& domain = chain_domains[i_chain][i];
+    TreeNode* tree_root = new TreeNode(chains[i_chain], domain);
+    tree_root->seed_rng(TreeNode::tree_seed(args.random_seed(), i_chain, i));
+    if (!packets.empty())
+      tree_root->set_packets(packets);
+    tree_root->build_tree(args.spfac(), args.binth(), dim_choice, cut_algo,
+        num_workers, args.compact_regions());
+    chain_trees[i_chain][i] = tree_root;
+  };
+  size_t num_large = 0;
+  for (; num_large < tree_jobs.size(); ++num_large) {
+    const DomainTuple& domain = chain_domains[
+        std::get<0>(tree_jobs[num_large])][std::get<1>(tree_jobs[num_large])];
+    const size_t num_domain_rules = std::get<1>(domain) -
+        std::get<0>(domain) + 1;
+    if (num_domain_rules * jobs <= total_domain_rules)
+      break;
+    build(num_large, jobs);
+  }
+  const WorkerPool pool(jobs);
+  pool.run(tree_jobs.size() - num_large, [&] (const size_t job) {
+    build(num_large + job, 1);
+  });
+}
+
+
+void tune::emit_trees(const std::vector<NodeRefVector>& chain_trees,
+    const ChainVector& chains, const std::vector<DomainVector>& chain_domains,
+    const size_t search, const DefaultPolicies& policies,
+    std::ostream& rule_out, std::vector<StrVector>& chain_names) {
+
+  const size_t num_chains = chains.size();
+  rule_out << std::endl;
+  chain_names.assign(num_chains, StrVector());
+  for (size_t i = 0; i < num_chains; ++i) {
+    Emitter emitter(chain_trees[i], chains[i], chain_domains[i], search);
+    emitter.emit(rule_out, chain_names[i], policies);
+  }
+}
+
+
+double tune::expected_evaluations(const std::vector<NodeRefVector>& chain_trees,
+    const ChainVector& chains,
+    const std::vector<DomainVector>& chain_domains) {
+
+  double evaluations = 0;
+  const size_t num_chains = chains.size();
+  for (size_t i = 0; i < num_chains; ++i) {
+    size_t num_outside = chains[i].size();
+    const size_t num_trees = chain_trees[i].size();
+    for (size_t j = 0; j < num_trees; ++j) {
+      const DomainTuple& domain = chain_domains[i][j];
+      num_outside -= std::get<1>(domain) - std::get<0>(domain) + 1;
+      evaluations += chain_trees[i][j]->expected_evaluations();
+    }
+    evaluations += num_outside;
+  }
+  return evaluations;
+}
+
+
+void tune::delete_trees(std::vector<NodeRefVector>& chain_trees) {
+  for (auto i = chain_trees.begin(); i != chain_trees.end(); ++i)
+    for (auto j = i->begin(); j != i->end(); ++j)
+      delete *j;
+  chain_trees.clear();
+}
+
+
+// tree parameters tried by autotune
+static const char* TUNE_BINTHS[] = {"4", "8", "16"};
+static const char* TUNE_SPFACS[] = {"1", "2", "4"};
+static const char* TUNE_DIM_CHOICES[] = {"max-dist", "least-max", "cost"};
+static const char* TUNE_CUT_ALGOS[] = {"equidistant", "hypersplit"};
+static const size_t NUM_TUNE_BINTHS = 3;
+static const size_t NUM_TUNE_SPFACS = 3;
+static const size_t NUM_TUNE_DIM_CHOICES = 3;
+static const size_t NUM_TUNE_CUT_ALGOS = 2;
+
+
+size_t tune::num_candidates() {
+  return NUM_TUNE_BINTHS * NUM_TUNE_SPFACS * NUM_TUNE_DIM_CHOICES
+      * NUM_TUNE_CUT_ALGOS;
+}
+
+
+void tune::candidates(const Arguments& args,
+    std::vector<Arguments>& candidates) {
+
+  const size_t num_candidates = tune::num_candidates();
+  for (size_t i = 0; i < num_candidates; ++i) {
+    size_t k = i;
+    Arguments candidate(args);
+    candidate.parse_cut_algo(TUNE_CUT_ALGOS[k % NUM_TUNE_CUT_ALGOS]);
+    k /= NUM_TUNE_CUT_ALGOS;
+    candidate.parse_dim_choice(TUNE_DIM_CHOICES[k % NUM_TUNE_DIM_CHOICES]);
+    k /= NUM_TUNE_DIM_CHOICES;
+    candidate.parse_spfac(TUNE_SPFACS[k % NUM_TUNE_SPFACS]);
+    k /= NUM_TUNE_SPFACS;
+    candidate.parse_binth(TUNE_BINTHS[k]);
+    candidates.push_back(candidate);
+  }
+}
+
+
+Arguments tune::autotune(const ChainVector& chains,
+    const std::vector<DomainVector>& chain_domains, const Arguments& args,
+    const PacketSet& packets, const DefaultPolicies& policies,
+    std::ostream& table_out) {
+
+  std::vector<Arguments> candidates;
+  tune::candidates(args, candidates);
+  const size_t num_candidates = candidates.size();
+  std::vector<size_t> num_rules(num_candidates, 0);
+  std::vector<double> evaluations(num_candidates, 0);
+  const WorkerPool pool(args.jobs());
+  pool.run(num_candidates, [&] (const size_t i) {
+    std::vector<NodeRefVector> chain_trees;
+    tune::build_trees(chains, chain_domains, candidates[i], packets, 1,
+        chain_trees);
+    evaluations[i] = tune::expected_evaluations(chain_trees, chains,
+        chain_domains);
+    // only the number of emitted rules is of interest
+    RuleCounter counter;
+    std::ostream rule_out(&counter);
+    std::vector<StrVector> chain_names;
+    tune::emit_trees(chain_trees, chains, chain_domains, args.search(),
+        policies, rule_out, chain_names);
+    num_rules[i] = counter.num_rules();
+    tune::delete_trees(chain_trees);
+  });
+  size_t best = 0;
+  table_out << "# binth spfac dim-choice cut-algo: rules, evaluations"
+      << std::endl;
+  for (size_t i = 0; i < num_candidates; ++i) {
+    const size_t k = i / NUM_TUNE_CUT_ALGOS;
+    table_out << "#   " << candidates[i].binth() << " "
+        << candidates[i].spfac() << " "
+        << TUNE_DIM_CHOICES[k % NUM_TUNE_DIM_CHOICES] << " "
+        << TUNE_CUT_ALGOS[i % NUM_TUNE_CUT_ALGOS] << ": " << num_rules[i]
+        << ", " << evaluations[i] << std::endl;
+    if (evaluations[i] < evaluations[best] || (evaluations[i]
+        == evaluations[best] && num_rules[i] < num_rules[best]))
+      best = i;
+  }
+  const size_t k = best / NUM_TUNE_CUT_ALGOS;
+  table_out << "# Autotuned: --binth " << candidates[best].binth()
+      << " --spfac " << candidates[best].spfac()
+      << " --dim-choice " << TUNE_DIM_CHOICES[k % NUM_TUNE_DIM_CHOICES]
+      << " --cut-algo " << TUNE_CUT_ALGOS[best % NUM_TUNE_CUT_ALGOS]
+      << std::endl;
+  return candidates[best];
+}
@@ -0,0 +1,66 @@
+#ifndef HITABLES_TUNE_HPP
+#define HITABLES_TUNE_HPP 1
+
+#include <cstdlib>
+#include <ostream>
+#include <vector>
+#include "treenode.hpp"
+
+namespace tune {
+
+  /*
+   * Builds one tree per (chain, sub-ruleset) pair with the tree parameters of
+   * args on the given number of workers.  The trees are weighted by the given
+   * packets, if any.
+   */
+  void build_trees(const ChainVector& chains,
+      const std::vector<DomainVector>& chain_domains, const Arguments& args,
+      const PacketSet& packets, const size_t jobs,
+      std::vector<NodeRefVector>& chain_trees);
+
+  /*
+   * Emits the rules of all trees to rule_out and the names of the chains they
+   * jump to to chain_names.
+   */
+  void emit_trees(const std::vector<NodeRefVector>& chain_trees,
+      const ChainVector& chains,
+      const std::vector<DomainVector>& chain_domains, const size_t search,
+      const DefaultPolicies& policies, std::ostream& rule_out,
+      std::vector<StrVector>& chain_names);
+
+  /*
+   * Estimates the number of rules a packet traverses in the emitted chains:
+   * the expected evaluations of every tree plus the rules outside of any
+   * sub-ruleset, which are matched one after another.
+   */
+  double expected_evaluations(const std::vector<NodeRefVector>& chain_trees,
+      const ChainVector& chains,
+      const std::vector<DomainVector>& chain_domains);
+
+  void delete_trees(std::vector<NodeRefVector>& chain_trees);
+
+  /*
+   * Number of tree parameter combinations tried by autotune.
+   */
+  size_t num_candidates();
+
+  /*
+   * Appends args with the tree parameters of every combination tried by
+   * autotune to candidates, in the order of the score table.
+   */
+  void candidates(const Arguments& args, std::vector<Arguments>& candidates);
+
+  /*
+   * Builds and emits the trees for every candidate and returns the one with
+   * the least expected rule evaluations per packet; fewer emitted rules break
+   * ties.  Candidates are built concurrently with one worker each, and only
+   * the number of their rules is kept of the output.  The score table and the
+   * chosen parameters are written to table_out as comments.
+   */
+  Arguments autotune(const ChainVector& chains,
+      const std::vector<DomainVector>& chain_domains, const Arguments& args,
+      const PacketSet& packets, const DefaultPolicies& policies,
+      std::ostream& table_out);
+}
+
+#endif // HITABLES_TUNE_HPP